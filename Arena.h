@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// allocates a cache's nodes out of large chunks it maps itself, which is what lets the chunks be placed:
+// Options::node binds every chunk to one NUMA node before it is first touched, so the cache's entries, index
+// and list nodes sit next to the threads that use them whichever thread happened to insert them.
+// freed blocks go on a free list per 16 byte size class and are reused, chunks are only returned to the
+// system when the arena is destroyed. arrays too large for a chunk (index buckets) get a mapping of their own.
+//
+// with Options::hugePages every mapping is a multiple of 2MB on a 2MB boundary and backed by huge pages, so
+// a few TLB entries cover what would otherwise take thousands of 4K ones: explicit MAP_HUGETLB pages from the
+// reserved pool first, and when the pool is empty (the common case) transparent huge pages asked for with
+// madvise. if THP is off too the arena still works, on 4K pages.
+//
+// not thread safe, the owning cache's lock covers it. it must outlive every container allocating from it
+class Arena {
+public:
+    static constexpr size_t HugePageSize = 2 * 1024 * 1024;
+
+    struct Options {
+        int node = -1; // NUMA node to bind chunks to, -1 leaves placement to the kernel
+        size_t chunkSize = 2 * 1024 * 1024;
+        bool hugePages = false;
+    };
+
+    Arena() : Arena(Options {}) {}
+
+    explicit Arena(Options options) : mOptions(options) {
+        if (mOptions.hugePages) {
+            mOptions.chunkSize = roundUp(mOptions.chunkSize, HugePageSize);
+        }
+    }
+
+    ~Arena() {
+        for (auto& [p, size] : mMappings) {
+            unmap(p, size);
+        }
+        for (auto& [p, size] : mLarge) {
+            unmap(p, size);
+        }
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes) {
+        size_t size = roundUp(bytes, Granularity);
+        if (size > mOptions.chunkSize / 4) {
+            size = mappedSize(size);
+            void* p = map(size);
+            mLarge.emplace_back(p, size);
+            return p;
+        }
+
+        size_t sizeClass = size / Granularity;
+        if (sizeClass < mFree.size() && mFree[sizeClass] != nullptr) {
+            FreeBlock* block = mFree[sizeClass];
+            mFree[sizeClass] = block->next;
+            return block;
+        }
+        if (mBumpLeft < size) {
+            // the tail of the old chunk is given up, it is smaller than the largest size class
+            mBump = static_cast<char*>(map(mOptions.chunkSize));
+            mBumpLeft = mOptions.chunkSize;
+            mMappings.emplace_back(mBump, mOptions.chunkSize);
+        }
+        void* p = mBump;
+        mBump += size;
+        mBumpLeft -= size;
+        return p;
+    }
+
+    void deallocate(void* p, size_t bytes) {
+        size_t size = roundUp(bytes, Granularity);
+        if (size > mOptions.chunkSize / 4) {
+            size = mappedSize(size);
+            for (auto it = mLarge.begin(); it != mLarge.end(); ++it) {
+                if (it->first == p) {
+                    unmap(p, size);
+                    *it = mLarge.back();
+                    mLarge.pop_back();
+                    return;
+                }
+            }
+            return;
+        }
+
+        size_t sizeClass = size / Granularity;
+        if (sizeClass >= mFree.size()) {
+            mFree.resize(sizeClass + 1, nullptr);
+        }
+        mFree[sizeClass] = new (p) FreeBlock {mFree[sizeClass]};
+    }
+
+    int node() const {
+        return mOptions.node;
+    }
+
+    // bytes mapped from the system, chunks and large arrays
+    size_t reservedBytes() const {
+        size_t total = 0;
+        for (const auto& mapping : mMappings) {
+            total += mapping.second;
+        }
+        for (const auto& mapping : mLarge) {
+            total += mapping.second;
+        }
+        return total;
+    }
+
+    // of reservedBytes(), the bytes taken from the explicit huge page pool
+    size_t hugeTlbBytes() const {
+        return mHugeTlbBytes;
+    }
+
+private:
+    static constexpr size_t Granularity = 16;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static size_t roundUp(size_t size, size_t to) {
+        return (std::max<size_t>(size, 1) + to - 1) / to * to;
+    }
+
+    // large arrays are mapped whole huge pages at a time
+    size_t mappedSize(size_t size) const {
+        return mOptions.hugePages ? roundUp(size, HugePageSize) : size;
+    }
+
+    void* map(size_t size) {
+#if defined(__linux__)
+        void* p = mOptions.hugePages
+            ? mapHuge(size)
+            : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        bind(p, size);
+        return p;
+#else
+        return ::operator new(size, std::align_val_t {Granularity});
+#endif
+    }
+
+    void unmap(void* p, size_t size) {
+#if defined(__linux__)
+        auto it = std::find(mHugeTlbMappings.begin(), mHugeTlbMappings.end(), p);
+        if (it != mHugeTlbMappings.end()) {
+            mHugeTlbBytes -= size;
+            *it = mHugeTlbMappings.back();
+            mHugeTlbMappings.pop_back();
+        }
+        munmap(p, size);
+#else
+        ::operator delete(p, std::align_val_t {Granularity});
+#endif
+    }
+
+#if defined(__linux__)
+    // size is a multiple of HugePageSize. THP only backs 2MB aligned ranges, so the fallback maps one huge
+    // page more than needed and trims the ends to land on a boundary
+    void* mapHuge(size_t size) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            mHugeTlbBytes += size;
+            mHugeTlbMappings.push_back(p);
+            return p;
+        }
+
+        void* raw = mmap(nullptr, size + HugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            return MAP_FAILED;
+        }
+        char* begin = static_cast<char*>(raw);
+        char* aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<uintptr_t>(begin), HugePageSize));
+        if (aligned != begin) {
+            munmap(begin, aligned - begin);
+        }
+        munmap(aligned + size, begin + HugePageSize - aligned);
+        madvise(aligned, size, MADV_HUGEPAGE);
+        return aligned;
+    }
+
+    // MPOL_PREFERRED rather than MPOL_BIND, a full node spills over to the others instead of failing the
+    // allocation. called through syscall() so that placement does not need libnuma; a node the kernel does
+    // not know (more nodes configured than the box has) is ignored and the pages land wherever they would
+    void bind(void* p, size_t size) {
+        if (mOptions.node < 0 || mOptions.node >= 63) {
+            return;
+        }
+        constexpr int MpolPreferred = 1;
+        unsigned long mask = 1UL << mOptions.node;
+        syscall(SYS_mbind, p, size, MpolPreferred, &mask, sizeof(mask) * 8, 0); // the kernel reads maxnode - 1 bits
+    }
+#endif
+
+    Options mOptions;
+    std::vector<FreeBlock*> mFree; // free list per size class
+    char* mBump = nullptr;
+    size_t mBumpLeft = 0;
+    std::vector<std::pair<void*, size_t>> mMappings;
+    std::vector<std::pair<void*, size_t>> mLarge;
+    std::vector<void*> mHugeTlbMappings; // mappings that came from the explicit pool
+    size_t mHugeTlbBytes = 0;
+};
+
+// standard allocator over an Arena, LFUCache's Alloc argument. copies and rebinds share the arena
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    static_assert(alignof(T) <= 16, "Arena blocks are 16 byte aligned.");
+
+    explicit ArenaAllocator(Arena& arena) : mArena(&arena) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : mArena(other.arena()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(mArena->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        mArena->deallocate(p, n * sizeof(T));
+    }
+
+    Arena* arena() const {
+        return mArena;
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return mArena == other.arena();
+    }
+
+private:
+    Arena* mArena;
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "IndexLinkedLFU.h"
+#include "LFUCache.h"
+
+// LFUCache with its entries in arrays sized for the capacity up front and linked by 32 bit slot index
+// (IndexLinkedLFU.h) instead of std::list nodes and 64 bit iterators, for caches of up to 2^32 - 2 entries.
+// the links of an entry take 44 bytes (slot, frequency node and bucket) against the index node, list node
+// and bucket pointer of LFUCache, there is no allocation after construction, and the arrays being contiguous
+// keeps what one lookup touches on fewer cache lines and pages.
+// eviction order is the same as LFUCache's: lowest frequency first, least recently used among equals
+template<typename K, typename V, typename Hash = DefaultHash<K>, typename KeyEqual = DefaultKeyEqual<K>>
+class CompactLFUCache {
+public:
+    explicit CompactLFUCache(size_t capacity, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual())
+        : mHash(hash), mEqual(equal) {
+        if (capacity <= 0 || capacity >= index_linked::Nil) {
+            throw std::invalid_argument ("Capacity must be between 1 and 2^32 - 2.");
+        }
+        uint32_t bucketCount = Lists::bucketCountFor(capacity);
+        mState = std::make_unique<index_linked::State>();
+        mState->capacity = static_cast<uint32_t>(capacity);
+        mState->bucketCount = bucketCount;
+        mBuckets.reset(new uint32_t[bucketCount]);
+        mSlots.reset(new index_linked::Slot[capacity]);
+        mNodes.reset(new index_linked::FreqNode[capacity]);
+        mItems.reset(new Item[capacity]);
+        mLists = Lists(mState.get(), mBuckets.get(), mSlots.get(), mNodes.get());
+        mLists.reset();
+    }
+
+    ~CompactLFUCache() {
+        if (mState) {
+            mLists.forEach([this](uint32_t s) { std::destroy_at(&mItems[s].entry); });
+        }
+    }
+
+    // the arrays move with their owners, the moved-from cache lets go of them and can only be destroyed
+    CompactLFUCache(CompactLFUCache&& other)
+        : mHash(std::move(other.mHash)), mEqual(std::move(other.mEqual)), mState(std::move(other.mState)),
+          mBuckets(std::move(other.mBuckets)), mSlots(std::move(other.mSlots)), mNodes(std::move(other.mNodes)),
+          mItems(std::move(other.mItems)), mLists(std::exchange(other.mLists, Lists(nullptr, nullptr, nullptr, nullptr))) {}
+    CompactLFUCache& operator=(CompactLFUCache&&) = delete;
+
+    size_t capacity() const {
+        return mState->capacity;
+    }
+
+    size_t size() const {
+        return mLists.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // bytes of the arrays, allocated in full by the constructor. memory the keys and values own is not included
+    size_t memoryBytes() const {
+        return mState->bucketCount * sizeof(uint32_t)
+            + mState->capacity * (sizeof(index_linked::Slot) + sizeof(index_linked::FreqNode) + sizeof(Item));
+    }
+
+    template<typename Q>
+    bool contains(const Q& key) const {
+        return findSlot(key) != index_linked::Nil;
+    }
+
+    // pointer to the cached value, counts as a use. nullptr on a miss
+    template<typename Q>
+    V* find(const Q& key) {
+        uint32_t s = findSlot(key);
+        if (s == index_linked::Nil) {
+            return nullptr;
+        }
+        mLists.touch(s);
+        return &mItems[s].entry.second;
+    }
+
+    // side effect free lookup, neither frequency nor recency of the key change
+    template<typename Q>
+    const V* peek(const Q& key) const {
+        uint32_t s = findSlot(key);
+        return s == index_linked::Nil ? nullptr : &mItems[s].entry.second;
+    }
+
+    // how often key has been used, 0 if it is not cached
+    template<typename Q>
+    int frequency(const Q& key) const {
+        uint32_t s = findSlot(key);
+        return s == index_linked::Nil ? 0 : static_cast<int>(mLists.frequency(s));
+    }
+
+    // assigns (and counts a use) if key is cached, otherwise inserts, evicting first when full
+    template<typename KArg = K, typename VArg = V>
+    void put(KArg&& key, VArg&& val) {
+        size_t hash = mHash(key);
+        uint32_t s = findSlot(key, hash);
+        if (s != index_linked::Nil) {
+            mLists.touch(s);
+            mItems[s].entry.second = std::forward<VArg>(val);
+            return;
+        }
+        if (mLists.full()) {
+            evict();
+        }
+        // the slot is linked before its entry exists, so a throwing key or value constructor must unlink it
+        s = mLists.insert(hash);
+        try {
+            std::construct_at(&mItems[s].entry, std::forward<KArg>(key), std::forward<VArg>(val));
+        } catch (...) {
+            mLists.remove(s);
+            throw;
+        }
+    }
+
+    template<typename Q>
+    bool erase(const Q& key) {
+        uint32_t s = findSlot(key);
+        if (s == index_linked::Nil) {
+            return false;
+        }
+        remove(s);
+        return true;
+    }
+
+    void evict() {
+        if (uint32_t victim = mLists.victim(); victim != index_linked::Nil) {
+            remove(victim);
+        }
+    }
+
+private:
+    using Lists = index_linked::Lists;
+
+    // raw storage for a slot's key and value, constructed on insert and destroyed on removal
+    union Item {
+        Item() {}
+        ~Item() {}
+
+        std::pair<K, V> entry;
+    };
+
+    template<typename Q>
+    uint32_t findSlot(const Q& key) const {
+        return findSlot(key, mHash(key));
+    }
+
+    template<typename Q>
+    uint32_t findSlot(const Q& key, size_t hash) const {
+        return mLists.find(hash, [&](uint32_t s) { return mEqual(mItems[s].entry.first, key); });
+    }
+
+    void remove(uint32_t s) {
+        mLists.remove(s);
+        std::destroy_at(&mItems[s].entry);
+    }
+
+    [[no_unique_address]] Hash mHash;
+    [[no_unique_address]] KeyEqual mEqual;
+    std::unique_ptr<index_linked::State> mState; // on the heap like the arrays, so mLists survives a move
+    std::unique_ptr<uint32_t[]> mBuckets;
+    std::unique_ptr<index_linked::Slot[]> mSlots;
+    std::unique_ptr<index_linked::FreqNode[]> mNodes;
+    std::unique_ptr<Item[]> mItems;
+    Lists mLists {nullptr, nullptr, nullptr, nullptr};
+};
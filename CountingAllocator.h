@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+// heap bytes and live blocks charged to one structure of a container
+struct MemoryCounter {
+    size_t bytes = 0;
+    size_t blocks = 0;
+};
+
+// node based containers allocate their nodes one at a time and their bucket arrays as arrays of pointers,
+// so allocations of pointer types are charged to buckets and everything else to nodes
+struct StructureCounters {
+    MemoryCounter nodes;
+    MemoryCounter buckets;
+};
+
+// forwards to Base (rebound to T) and records every allocation in the counters it was constructed with.
+// a default constructed allocator has no counters and counts nothing
+template<typename T, typename Base = std::allocator<T>>
+class CountingAllocator {
+public:
+    using value_type = T;
+    using BaseTraits = std::allocator_traits<Base>::template rebind_traits<T>;
+    using BaseAlloc = std::allocator_traits<Base>::template rebind_alloc<T>;
+
+    // containers moved or swapped take the counters along, their nodes were charged there
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template<typename U>
+    struct rebind {
+        using other = CountingAllocator<U, Base>;
+    };
+
+    CountingAllocator() = default;
+    explicit CountingAllocator(StructureCounters* counters, const Base& base = Base())
+        : mBase(base), mCounters(counters) {}
+
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U, Base>& other) : mBase(other.base()), mCounters(other.counters()) {}
+
+    T* allocate(size_t n) {
+        T* p = BaseTraits::allocate(mBase, n);
+        if (mCounters) {
+            MemoryCounter& counter = std::is_pointer_v<T> ? mCounters->buckets : mCounters->nodes;
+            counter.bytes += n * sizeof(T);
+            counter.blocks += 1;
+        }
+        return p;
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (mCounters) {
+            MemoryCounter& counter = std::is_pointer_v<T> ? mCounters->buckets : mCounters->nodes;
+            counter.bytes -= n * sizeof(T);
+            counter.blocks -= 1;
+        }
+        BaseTraits::deallocate(mBase, p, n);
+    }
+
+    const BaseAlloc& base() const {
+        return mBase;
+    }
+
+    StructureCounters* counters() const {
+        return mCounters;
+    }
+
+    template<typename U>
+    bool operator==(const CountingAllocator<U, Base>& other) const {
+        return mCounters == other.counters() && mBase == other.base();
+    }
+
+private:
+    [[no_unique_address]] BaseAlloc mBase;
+    StructureCounters* mCounters = nullptr;
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// LFU bookkeeping for caches that keep their entries in a fixed array of slots and link them by 32 bit slot
+// index instead of pointer: a chained hash index over the slots, and the frequencies as a list of nodes in
+// increasing order, each holding its slots most recently used first. the victim is the tail of the first
+// node, and every operation is O(1) without a freq -> list map.
+//
+// it owns none of its memory, the cache hands it the arrays (on the heap for CompactLFUCache, in a shared
+// memory segment for SharedLFUCache) and stores the keys and values of the slots itself
+namespace index_linked {
+
+inline constexpr uint32_t Nil = UINT32_MAX;
+
+struct State {
+    uint32_t capacity;
+    uint32_t bucketCount; // power of two
+    uint32_t size;
+    uint32_t freeSlot;  // free slots chained through bucketNext
+    uint32_t freeNode;  // free frequency nodes chained through next
+    uint32_t firstNode; // node of the lowest frequency, Nil when empty
+};
+
+// 20 bytes, against two list pointers, a list iterator and a stored hash per entry in LFUCache
+struct Slot {
+    uint32_t hash;       // low bits of the key's hash, all that bucket counts up to 2^31 need
+    uint32_t bucketNext; // next slot in the same bucket
+    uint32_t prev;       // towards the head (more recently used) of the node's list
+    uint32_t next;
+    uint32_t node;       // frequency node the slot is on
+};
+
+struct FreqNode {
+    uint32_t freq;
+    uint32_t head; // most recently used slot at freq
+    uint32_t tail; // least recently used slot at freq
+    uint32_t prev; // node of the next lower frequency
+    uint32_t next; // node of the next higher frequency
+};
+
+// capacity slots and nodes (never more distinct frequencies than slots) and bucketCount buckets
+class Lists {
+public:
+    Lists(State* state, uint32_t* buckets, Slot* slots, FreqNode* nodes)
+        : mState(state), mBuckets(buckets), mSlots(slots), mNodes(nodes) {}
+
+    // one bucket per slot, at most 2^31 so the count fits 32 bits
+    static uint32_t bucketCountFor(size_t capacity) {
+        return static_cast<uint32_t>(std::min<size_t>(std::bit_ceil(capacity), size_t(1) << 31));
+    }
+
+    // empty, every slot and node on its free list. state's capacity and bucketCount must be set
+    void reset() {
+        uint32_t capacity = mState->capacity;
+        std::fill(mBuckets, mBuckets + mState->bucketCount, Nil);
+        for (uint32_t i = 0; i < capacity; ++i) {
+            mSlots[i].bucketNext = i + 1 < capacity ? i + 1 : Nil;
+            mNodes[i].next = i + 1 < capacity ? i + 1 : Nil;
+        }
+        mState->size = 0;
+        mState->freeSlot = 0;
+        mState->freeNode = 0;
+        mState->firstNode = Nil;
+    }
+
+    uint32_t size() const {
+        return mState->size;
+    }
+
+    bool full() const {
+        return mState->size == mState->capacity;
+    }
+
+    // slot with hash for which matches(slot) holds, Nil if there is none
+    template<typename Match>
+    uint32_t find(uint64_t hash, Match&& matches) const {
+        for (uint32_t s = bucketOf(hash); s != Nil; s = mSlots[s].bucketNext) {
+            if (mSlots[s].hash == static_cast<uint32_t>(hash) && matches(s)) {
+                return s;
+            }
+        }
+        return Nil;
+    }
+
+    // takes a free slot for hash at frequency 1, the cache must not be full
+    uint32_t insert(uint64_t hash) {
+        uint32_t s = mState->freeSlot;
+        Slot& slot = mSlots[s];
+        mState->freeSlot = slot.bucketNext;
+        slot.hash = static_cast<uint32_t>(hash);
+        slot.bucketNext = bucketOf(hash);
+        bucketOf(hash) = s;
+
+        uint32_t first = mState->firstNode;
+        uint32_t node = first != Nil && mNodes[first].freq == 1 ? first : insertNodeAfter(Nil, 1);
+        pushFront(node, s);
+        mState->size += 1;
+        return s;
+    }
+
+    // moves s to the head of the node one frequency up, creating that node if needed. a slot alone on its
+    // node takes the node up with it instead, which is also why capacity nodes are always enough
+    void touch(uint32_t s) {
+        uint32_t node = mSlots[s].node;
+        uint32_t freq = mNodes[node].freq + 1;
+        uint32_t next = mNodes[node].next;
+        if (next == Nil || mNodes[next].freq != freq) {
+            if (mNodes[node].head == mNodes[node].tail) {
+                mNodes[node].freq = freq;
+                return;
+            }
+            next = insertNodeAfter(node, freq);
+        }
+        unlink(s);
+        pushFront(next, s);
+    }
+
+    // unlinks s from the index and its list and frees it
+    void remove(uint32_t s) {
+        Slot& slot = mSlots[s];
+        uint32_t* link = &bucketOf(slot.hash);
+        while (*link != s) {
+            link = &mSlots[*link].bucketNext;
+        }
+        *link = slot.bucketNext;
+
+        unlink(s);
+        slot.bucketNext = mState->freeSlot;
+        mState->freeSlot = s;
+        mState->size -= 1;
+    }
+
+    // least recently used slot of the lowest frequency, Nil when empty
+    uint32_t victim() const {
+        return mState->firstNode == Nil ? Nil : mNodes[mState->firstNode].tail;
+    }
+
+    uint32_t frequency(uint32_t s) const {
+        return mNodes[mSlots[s].node].freq;
+    }
+
+    // calls fn(slot) for every used slot, in bucket order
+    template<typename Fn>
+    void forEach(Fn&& fn) const {
+        for (uint32_t b = 0; b < mState->bucketCount; ++b) {
+            for (uint32_t s = mBuckets[b]; s != Nil;) {
+                uint32_t next = mSlots[s].bucketNext; // fn may free s
+                fn(s);
+                s = next;
+            }
+        }
+    }
+
+private:
+    uint32_t& bucketOf(uint64_t hash) const {
+        return mBuckets[hash & (mState->bucketCount - 1)];
+    }
+
+    // new node with freq after node (at the front for Nil)
+    uint32_t insertNodeAfter(uint32_t node, uint32_t freq) {
+        uint32_t n = mState->freeNode;
+        FreqNode& created = mNodes[n];
+        mState->freeNode = created.next;
+        created.freq = freq;
+        created.head = Nil;
+        created.tail = Nil;
+        created.prev = node;
+        created.next = node == Nil ? mState->firstNode : mNodes[node].next;
+        if (created.next != Nil) {
+            mNodes[created.next].prev = n;
+        }
+        if (node == Nil) {
+            mState->firstNode = n;
+        } else {
+            mNodes[node].next = n;
+        }
+        return n;
+    }
+
+    void pushFront(uint32_t node, uint32_t s) {
+        Slot& slot = mSlots[s];
+        FreqNode& n = mNodes[node];
+        slot.node = node;
+        slot.prev = Nil;
+        slot.next = n.head;
+        if (n.head != Nil) {
+            mSlots[n.head].prev = s;
+        } else {
+            n.tail = s;
+        }
+        n.head = s;
+    }
+
+    // takes s off its node's list and frees the node if that leaves it empty
+    void unlink(uint32_t s) {
+        Slot& slot = mSlots[s];
+        FreqNode& n = mNodes[slot.node];
+        (slot.prev != Nil ? mSlots[slot.prev].next : n.head) = slot.next;
+        (slot.next != Nil ? mSlots[slot.next].prev : n.tail) = slot.prev;
+        if (n.head != Nil) {
+            return;
+        }
+
+        (n.prev != Nil ? mNodes[n.prev].next : mState->firstNode) = n.next;
+        if (n.next != Nil) {
+            mNodes[n.next].prev = n.prev;
+        }
+        n.next = mState->freeNode;
+        mState->freeNode = slot.node;
+    }
+
+    State* mState;
+    uint32_t* mBuckets;
+    Slot* mSlots;
+    FreqNode* mNodes;
+};
+
+} // namespace index_linked
@@ -1,121 +1,137 @@
 #include <iostream>
-#include <vector>
-#include <unordered_map>
-#include <list>
-#include <concepts>
+#include <atomic>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string_view>
+#include <thread>
 
-template<typename T>
-concept DefaultContructible = std::is_default_constructible<T>::value;
+#include "CompactLFUCache.h"
+#include "LFUCache.h"
+#include "NumaLFUCache.h"
+#include "SampledLFUCache.h"
+#include "ShardedLFUCache.h"
+#include "WriteBackCache.h"
 
-template<typename K, typename V>
-    requires DefaultContructible<V>
-class LFUCache {
-private:
-    using LstIter = std::list<K>::iterator;
+#if defined(__linux__)
+#include <sys/wait.h>
+#include <unistd.h>
 
-    struct KeyMeta {
-        LstIter iter;
-        int freq;
-        V val;
-    };
+#include "SharedLFUCache.h"
+#endif
 
-    size_t mCapacity;
-    int mMinFreq; // minimum frequency of all keys
-    std::unordered_map<int, std::list<K>> mKeysByFreq; // freq -> list of keys, the head of list is the key most recently used, the tail is least recently used
-    std::unordered_map<K, KeyMeta> mKeyMetaByKey;      // key -> [iterator to key's pos in list, freq, value]
+// every heap allocation of the test binary, lets tests check a call does not allocate
+static size_t gAllocations = 0;
 
-public:
-    LFUCache(size_t capacity) : mCapacity(capacity), mMinFreq(0) {
-        if (capacity <= 0) {
-            throw std::invalid_argument ("Capacity cannot be less than or equal to zero.");
-        }
+// every form of new and delete is replaced so each delete matches the new it frees. none of them is inlined,
+// gcc would otherwise see malloc on one side and operator delete on the other and warn of a mismatch
+[[gnu::noinline]] void* operator new(size_t size) {
+    gAllocations += 1;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
     }
-    ~LFUCache() = default;
+    throw std::bad_alloc();
+}
 
-    bool contains(K key) const {
-        return mKeyMetaByKey.find(key) != mKeyMetaByKey.end();
-    }
+[[gnu::noinline]] void* operator new[](size_t size) {
+    return operator new(size);
+}
 
-    bool empty() const {
-        return mKeyMetaByKey.empty();
+[[gnu::noinline]] void* operator new(size_t size, std::align_val_t align) {
+    gAllocations += 1;
+    size_t alignment = static_cast<size_t>(align);
+    size_t rounded = ((size ? size : 1) + alignment - 1) / alignment * alignment; // aligned_alloc wants a multiple
+    if (void* p = std::aligned_alloc(alignment, rounded)) {
+        return p;
     }
+    throw std::bad_alloc();
+}
 
-    size_t size() const {
-        return mKeyMetaByKey.size();
-    }
+[[gnu::noinline]] void* operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
 
-    V get(K key) {
-        if (contains(key)) {
-            // cache hit
-            touch(key);
-            return mKeyMetaByKey[key].val;
-        }
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    std::free(p);
+}
 
-        // cache miss, we put a default constructed value in our cache
-        V defaultVal = V();
-        put(key, defaultVal);
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
 
-        return defaultVal;
-    }
+[[gnu::noinline]] void operator delete[](void* p) noexcept {
+    std::free(p);
+}
 
-    void put(K key, V val) {
-        if (contains(key)) {
-            // cache contains val, update existing entry
-            touch(key);
-            mKeyMetaByKey[key].val = val;
-            return;
-        }
+[[gnu::noinline]] void operator delete[](void* p, size_t) noexcept {
+    std::free(p);
+}
 
-        if (mKeyMetaByKey.size() == mCapacity) {
-            evict();
-        }
+[[gnu::noinline]] void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
 
-        mMinFreq = 1;
-        mKeysByFreq[mMinFreq].push_front(key);
-        KeyMeta curKeyMetaData {mKeysByFreq[mMinFreq].begin(), 1, val};
-        mKeyMetaByKey[key] = curKeyMetaData;
-    }
+[[gnu::noinline]] void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
 
-    void touch(K key) {
-        auto keyMeta = mKeyMetaByKey[key];
-        auto iter = keyMeta.iter;
-        int oldFreq = keyMeta.freq;
-        int newFreq = oldFreq + 1;
+[[gnu::noinline]] void operator delete[](void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
 
-        mKeysByFreq[oldFreq].erase(iter); // delete entry in list of keys at old freq
-        
-        mKeyMetaByKey[key].freq = newFreq; // update freq
-        mKeysByFreq[newFreq].push_front(key); // add entry at head of list of keys at new freq
-        mKeyMetaByKey[key].iter = mKeysByFreq[newFreq].begin();
+[[gnu::noinline]] void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
 
-        if (mKeysByFreq[mMinFreq].empty()) {
-            // as result of touch, if no element is of min freq, then min freq must be incremented
-            mMinFreq += 1;
-        }
-    }
+// counts copies so tests can check values are moved or built in place rather than copied
+struct CopyCounted {
+    static inline int copies = 0;
+    int id = 0;
+
+    CopyCounted() = default;
+    explicit CopyCounted(int id) : id(id) {}
+    CopyCounted(const CopyCounted& other) : id(other.id) { copies += 1; }
+    CopyCounted(CopyCounted&&) = default;
+    CopyCounted& operator=(const CopyCounted& other) { id = other.id; copies += 1; return *this; }
+    CopyCounted& operator=(CopyCounted&&) = default;
+};
 
-    void evict() {
-        K key = mKeysByFreq[mMinFreq].back(); // key with least frequency and least recently used
+struct NonDefaultConstructible {
+    NonDefaultConstructible() = delete;
+    explicit NonDefaultConstructible(int id) : id(id) {}
+    int id;
+};
+
+// counts calls so tests can check how often the cache hashes a key
+struct CountingHash {
+    static inline int calls = 0;
 
-        mKeyMetaByKey.erase(key);
-        mKeysByFreq[mMinFreq].pop_back();
+    size_t operator()(int key) const {
+        calls += 1;
+        return std::hash<int>()(key);
     }
 };
 
-// should put template in header file though..
+// instantiate every member once so the whole template is compiled
 template class LFUCache<int, int>;
 
 int main() {
     /*
-    1. instantiation with a non-default constructible type for value should
-       give us compile error
+    1. a non-default constructible type for value can be cached through emplace, insertOrAssign and find,
+       only get should give us compile error as it inserts a default constructed value on a miss
 
     struct NonDefaultConstructible {
         NonDefaultConstructible() = delete;
     }
 
-    LFUCache<int, NonDefaultConstructible> cache(1); <-- compile error
+    LFUCache<int, NonDefaultConstructible> cache(1);
+    cache.get(1); <-- compile error
 
     2. construct with negative or zero capacity should throw invalid argument
        if using google test the test can be written as
@@ -300,4 +316,1060 @@ int main() {
         assert(manyCapCache.contains(4) == true);
     }
 
+    {
+        // test latency histogram bucketing, percentiles and merge
+        LatencyHistogram histogram;
+        assert(histogram.count() == 0);
+        assert(histogram.percentile(0.99) == 0);
+
+        for (uint64_t v = 1; v <= 1000; ++v) {
+            histogram.record(v);
+        }
+        assert(histogram.count() == 1000);
+        assert(histogram.min() == 1);
+        assert(histogram.max() == 1000);
+        assert(histogram.percentile(0.0) == 1);
+        assert(histogram.percentile(1.0) == 1000);
+
+        // log-linear buckets keep the relative error under 1/32
+        uint64_t p50 = histogram.percentile(0.5);
+        assert(p50 >= 500 && p50 <= 500 + 500 / 32);
+        uint64_t p99 = histogram.percentile(0.99);
+        assert(p99 >= 990 && p99 <= 990 + 990 / 32);
+
+        LatencyHistogram other;
+        other.record(1'000'000);
+        histogram.merge(other);
+        assert(histogram.count() == 1001);
+        assert(histogram.max() == 1'000'000);
+        assert(histogram.percentile(1.0) == 1'000'000);
+
+        for (uint64_t v : {uint64_t{0}, uint64_t{31}, uint64_t{32}, uint64_t{12345}, uint64_t{1} << 40}) {
+            size_t bucket = LatencyHistogram::bucketOf(v);
+            assert(LatencyHistogram::highestOf(bucket) >= v);
+            assert(bucket == 0 || LatencyHistogram::highestOf(bucket - 1) < v);
+        }
+
+        LatencyStats stats;
+        stats.setSamplePeriod(2);
+        assert(stats.sample(LatencyOp::Put) == nullptr);
+        assert(stats.sample(LatencyOp::Put) == &stats[LatencyOp::Put]);
+        stats[LatencyOp::Put].record(100);
+        std::ostringstream json;
+        stats.dumpJson(json);
+        assert(json.str().find("\"put\":{\"count\":1") != std::string::npos);
+    }
+
+#ifdef LFU_CACHE_LATENCY
+    {
+        // test latency instrumentation records every operation, eviction included
+        LFUCache<int, int> cache(2);
+        cache.setLatencySamplePeriod(1);
+        cache.put(1, 1);
+        cache.put(2, 2);
+        cache.get(1);
+        cache.put(3, 3);
+
+        const LatencyStats& stats = cache.latencyStats();
+        assert(stats[LatencyOp::Put].count() == 3);
+        assert(stats[LatencyOp::Get].count() == 1);
+        assert(stats[LatencyOp::Touch].count() == 1);
+        assert(stats[LatencyOp::Evict].count() == 1);
+
+        cache.resetLatencyStats();
+        assert(cache.latencyStats()[LatencyOp::Put].count() == 0);
+
+        cache.setLatencySamplePeriod(4);
+        for (int i = 0; i < 8; ++i) {
+            cache.put(i, i);
+        }
+        assert(cache.latencyStats()[LatencyOp::Put].count() == 2);
+    }
+#endif
+
+    {
+        // test frequency distribution, hottest keys and age of the next victim
+        LFUCache<int, int> cache(4);
+        assert(cache.freqDistribution().empty());
+        assert(cache.hottestKeys(2).empty());
+#ifdef LFU_CACHE_ENTRY_AGE
+        assert(cache.oldestMinFreqAge() == 0);
+#endif
+
+        cache.put(1, 1);
+        cache.put(2, 2);
+        cache.put(3, 3);
+        cache.put(4, 4);
+        cache.get(2);
+        cache.get(3);
+        cache.get(3);
+
+        auto buckets = cache.freqDistribution();
+        assert(buckets.size() == 3);
+        assert(buckets[0].freq == 1 && buckets[0].count == 2);
+        assert(buckets[1].freq == 2 && buckets[1].count == 1);
+        assert(buckets[2].freq == 3 && buckets[2].count == 1);
+
+        auto hottest = cache.hottestKeys(2);
+        assert(hottest.size() == 2);
+        assert(hottest[0].first == 3 && hottest[0].second == 3);
+        assert(hottest[1].first == 2 && hottest[1].second == 2);
+        assert(cache.hottestKeys(10).size() == 4);
+
+#ifdef LFU_CACHE_ENTRY_AGE
+        // key 1 is the next victim, 6 inserts/touches happened since it was inserted
+        assert(cache.oldestMinFreqAge() == 6);
+#endif
+        cache.put(5, 5);
+        assert(cache.contains(1) == false);
+        assert(cache.freqDistribution().front().count == 2);
+#ifdef LFU_CACHE_ENTRY_AGE
+        assert(cache.oldestMinFreqAge() == 4); // key 4 is the victim now
+#endif
+    }
+
+    {
+        // test memory accounting follows inserts, promotions and evictions
+        LFUCache<int, int> cache(3);
+        assert(cache.memoryUsage().indexNodes.blocks == 0);
+        assert(cache.memoryUsage().listNodes.blocks == 0);
+
+        cache.put(1, 1);
+        cache.put(2, 2);
+        cache.put(3, 3);
+        cache.get(1);
+        cache.put(4, 4);
+
+        MemoryUsage usage = cache.memoryUsage();
+        assert(usage.indexNodes.blocks == cache.size());
+        assert(usage.listNodes.blocks == cache.size());
+        assert(usage.listNodes.bytes >= cache.size() * sizeof(int));
+        assert(usage.indexBuckets.bytes > 0);
+        assert(usage.freqNodes.blocks == 2); // lists for freq 1 and 2
+        assert(usage.dirtyNodes.blocks == 0 && usage.dirtyBuckets.blocks == 0); // write-back is off
+        assert(usage.total() == usage.indexNodes.bytes + usage.indexBuckets.bytes + usage.listNodes.bytes
+                                + usage.freqNodes.bytes + usage.freqBuckets.bytes + usage.dirtyNodes.bytes
+                                + usage.dirtyBuckets.bytes);
+
+        // moving the cache keeps the counters attached
+        LFUCache<int, int> moved(std::move(cache));
+        moved.put(5, 5);
+        assert(moved.memoryUsage().indexNodes.blocks == moved.size());
+        assert(moved.memoryUsage().listNodes.blocks == moved.size());
+
+        // the moved-from cache is empty and usable, charging counters of its own
+        assert(cache.size() == 0);
+        assert(cache.memoryUsage().indexNodes.blocks == 0);
+        assert(cache.memoryUsage().listNodes.blocks == 0);
+        cache.put(6, 6);
+        assert(cache.get(6) == 6);
+        assert(cache.memoryUsage().indexNodes.blocks == 1);
+        assert(moved.memoryUsage().indexNodes.blocks == moved.size());
+    }
+
+    {
+        // test move assignment into a populated cache frees its old entries before taking the new counters
+        LFUCache<int, std::string> target(4);
+        for (int i = 0; i < 4; i++) {
+            target.put(i, std::string(64, 'a' + i));
+        }
+        target.get(0);
+
+        LFUCache<int, std::string> source(2);
+        source.put(10, "ten");
+        source.put(11, "eleven");
+        source.get(10);
+
+        target = std::move(source);
+        assert(target.size() == 2);
+        assert(target.get(10) == "ten");
+        assert(target.get(11) == "eleven");
+        assert(!target.contains(0));
+        assert(target.memoryUsage().indexNodes.blocks == 2);
+        assert(target.memoryUsage().listNodes.blocks == 2);
+        target.put(12, "twelve"); // capacity came along with the entries
+        assert(target.size() == 2);
+
+        assert(source.size() == 0);
+        assert(source.memoryUsage().indexNodes.blocks == 0);
+        assert(source.memoryUsage().freqNodes.blocks == 0);
+        source.put(1, "one");
+        source.put(2, "two");
+        source.put(3, "three");
+        assert(source.size() == 2);
+        assert(source.memoryUsage().indexNodes.blocks == 2);
+
+        LFUCache<int, std::string>& self = target;
+        target = std::move(self); // self move assignment leaves the cache as it was
+        assert(target.size() == 2);
+        assert(target.memoryUsage().indexNodes.blocks == 2);
+    }
+
+    {
+        // test non-trivial keys and values are moved into the cache, not copied
+        static_assert(PassByValue<int> && PassByValue<double>);
+        static_assert(!PassByValue<std::string>);
+
+        LFUCache<std::string, CopyCounted> cache(2);
+        CopyCounted::copies = 0;
+
+        cache.put("alpha", CopyCounted(1)); // key converted once from const char*, value moved
+        cache.put(std::string("beta"), CopyCounted(2));
+        assert(CopyCounted::copies == 0);
+
+        cache.put("alpha", CopyCounted(3)); // update moves the new value in
+        assert(CopyCounted::copies == 0);
+
+        CopyCounted gamma(4);
+        cache.put("gamma", gamma); // lvalue is copied exactly once
+        assert(CopyCounted::copies == 1);
+        assert(cache.contains("beta") == false); // alpha was used twice, beta once
+
+        assert(cache.get("alpha").id == 3);
+        assert(cache.get("gamma").id == 4);
+        assert(cache.get("delta").id == 0); // miss builds the default value in place
+        assert(cache.size() == 2);
+        assert(cache.contains("gamma") == false); // gamma used twice, alpha three times
+    }
+
+    {
+        // test move-only values through emplace, insertOrAssign and pointer lookups
+        LFUCache<int, std::unique_ptr<int>> cache(2);
+
+        auto [one, inserted] = cache.emplace(1, std::make_unique<int>(1));
+        assert(inserted == true && **one == 1);
+
+        auto [again, insertedAgain] = cache.emplace(1, std::make_unique<int>(100)); // existing value is kept
+        assert(insertedAgain == false && **again == 1);
+
+        assert(cache.insertOrAssign(2, std::make_unique<int>(2)) == true);
+        assert(cache.insertOrAssign(2, std::make_unique<int>(20)) == false);
+        assert(**cache.peek(2) == 20);
+
+        assert(cache.find(3) == nullptr); // a miss does not insert
+        assert(cache.size() == 2);
+
+        // peek does not count as a use: 1 and 2 are both at freq 2, 1 is least recently used
+        assert(**cache.peek(1) == 1);
+        cache.put(3, std::make_unique<int>(3));
+        assert(cache.contains(1) == false);
+        assert(cache.contains(2) == true);
+
+        // find does count: 3 goes to freq 2 and is more recent than 2
+        assert(**cache.find(3) == 3);
+        cache.put(4, std::make_unique<int>(4));
+        assert(cache.contains(2) == false);
+        assert(cache.contains(3) == true);
+    }
+
+    {
+        // test a value type without default constructor
+        LFUCache<int, NonDefaultConstructible> cache(1);
+        cache.emplace(1, 1);
+        assert(cache.peek(1)->id == 1);
+        cache.put(1, NonDefaultConstructible(2));
+        assert(cache.find(1)->id == 2);
+        cache.emplace(2, 3);
+        assert(cache.contains(1) == false);
+        assert(cache.peek(2)->id == 3);
+    }
+
+    {
+        // test string keyed caches are probed with string_view and const char* without building a std::string
+        LFUCache<std::string, int> cache(2);
+        const std::string longKey = "a key well past the small string optimization";
+        cache.put(longKey, 1);
+        cache.put("another key well past the small string optimization", 2);
+
+        // frequency lists 2 to 4 exist up front, so promoting longKey below does not allocate either
+        for (int i = 0; i < 3; ++i) {
+            cache.touch("another key well past the small string optimization");
+        }
+
+        std::string_view view = longKey;
+        size_t allocations = gAllocations;
+        assert(cache.contains(view) == true);
+        assert(cache.contains("no such key, also longer than the small string buffer") == false);
+        assert(*cache.peek(view) == 1);
+        assert(*cache.find(view) == 1);
+        assert(cache.get(view) == 1);
+        cache.touch(view);
+        assert(gAllocations == allocations);
+
+        // a miss through get still inserts, the key is built once for the cache itself
+        assert(cache.get(std::string_view("short")) == 0);
+        assert(cache.contains("short") == true);
+        assert(cache.contains(longKey) == true);
+        assert(cache.contains("another key well past the small string optimization") == false); // same freq, older
+    }
+
+    {
+        // test every key is hashed once per call, rehashing the index and evicting reuse the stored hash
+        LFUCache<int, int, CountingHash> cache(64);
+        CountingHash::calls = 0;
+        for (int i = 0; i < 64; ++i) {
+            cache.put(i, i); // the index was sized for 64 keys by the constructor and does not rehash
+        }
+        assert(CountingHash::calls == 64);
+
+        size_t bucketBytes = cache.memoryUsage().indexBuckets.bytes;
+        cache.rehash(1024);
+        assert(cache.memoryUsage().indexBuckets.bytes > bucketBytes);
+        assert(CountingHash::calls == 64);
+
+        cache.put(64, 64); // evicts 0
+        assert(CountingHash::calls == 65);
+        assert(cache.contains(0) == false);
+
+        // with the hash known up front the key is not hashed at all
+        size_t hash = cache.hashOf(100);
+        CountingHash::calls = 0;
+        cache.putHashed(hash, 100, 100);
+        assert(*cache.findHashed(hash, 100) == 100);
+        cache.putHashed(hash, 100, 101);
+        assert(*cache.findHashed(hash, 100) == 101);
+        assert(CountingHash::calls == 0);
+        assert(cache.findHashed(cache.hashOf(1000), 1000) == nullptr);
+    }
+
+    {
+        // test the index is sized for capacity up front and never rehashes while filling up
+        LFUCache<int, int> cache(1000);
+        MemoryCounter buckets = cache.memoryUsage().indexBuckets;
+        assert(buckets.blocks == 1);
+        for (int i = 0; i < 2000; ++i) {
+            cache.put(i, i);
+        }
+        assert(cache.memoryUsage().indexBuckets.bytes == buckets.bytes);
+        assert(cache.memoryUsage().indexBuckets.blocks == 1);
+    }
+
+    {
+        // test the removal listener gets key and value for every cause
+        using Cache = LFUCache<int, int>;
+        std::vector<Cache::Removal> removals;
+        Cache cache(2);
+        cache.setRemovalListener([&](int&& key, int&& val, RemovalCause cause) {
+            removals.push_back({key, val, cause});
+        });
+
+        cache.put(1, 1);
+        cache.put(2, 2);
+        cache.put(1, 10);
+        assert(removals.size() == 1);
+        assert(removals[0].key == 1 && removals[0].val == 1 && removals[0].cause == RemovalCause::Replaced);
+
+        cache.put(3, 3); // 2 is the only key at freq 1
+        assert(removals.size() == 2);
+        assert(removals[1].key == 2 && removals[1].val == 2 && removals[1].cause == RemovalCause::Size);
+
+        assert(cache.erase(3) == true);
+        assert(cache.erase(3) == false);
+        assert(removals.size() == 3);
+        assert(removals[2].key == 3 && removals[2].val == 3 && removals[2].cause == RemovalCause::Explicit);
+        assert(cache.size() == 1);
+
+        // erasing the last key at min freq moves min freq up to the next key, 1 at freq 2
+        cache.evict();
+        assert(cache.empty());
+        assert(removals.size() == 4 && removals[3].key == 1 && removals[3].val == 10);
+    }
+
+    {
+        // test deferred delivery queues move-only values until the batch is taken
+        LFUCache<int, std::unique_ptr<int>> cache(1);
+        std::vector<int> removed;
+        cache.setRemovalListener([&](int&& key, std::unique_ptr<int>&& val, RemovalCause) {
+            removed.push_back(key * 100 + *val);
+        }, RemovalDelivery::Deferred);
+
+        cache.put(1, std::make_unique<int>(1));
+        cache.put(2, std::make_unique<int>(2));
+        cache.put(3, std::make_unique<int>(3));
+        assert(removed.empty());
+
+        auto batch = cache.takeRemovals();
+        assert(batch.size() == 2);
+        assert(cache.takeRemovals().empty());
+        cache.deliverRemovals(batch);
+        assert((removed == std::vector<int> {101, 202}));
+
+        cache.erase(3);
+        assert(cache.flushRemovals() == 1);
+        assert(removed.back() == 303);
+    }
+
+    {
+        // test write-back mode marks writes dirty, coalesces them and writes dirty victims before dropping them
+        LFUCache<int, int> cache(2);
+        std::vector<std::pair<int, int>> written;
+        cache.setWriteBack([&](const int& key, const int& val) {
+            written.emplace_back(key, val);
+        });
+
+        cache.put(1, 1);
+        cache.put(2, 2);
+        cache.put(1, 11);
+        assert(cache.dirtyCount() == 2);
+        assert(cache.flushDirty(1) == 1);
+        assert((written == std::vector<std::pair<int, int>> {{1, 11}}));
+        assert(cache.isDirty(1) == false);
+        assert(cache.isDirty(2) == true);
+
+        cache.put(3, 3); // 2 is the victim and still dirty
+        assert((written.back() == std::pair<int, int> {2, 2}));
+        assert(cache.dirtyCount() == 1);
+
+        assert(cache.erase(3) == true); // dropped along with its pending write
+        assert(cache.dirtyCount() == 0);
+        assert(cache.flushDirty() == 0);
+        assert(written.size() == 2);
+    }
+
+    {
+        // test CleanOnly skips a dirty least frequently used key when a clean one is close by
+        LFUCache<int, int> cache(3);
+        size_t writes = 0;
+        cache.setWriteBack([&](const int&, const int&) { writes += 1; }, WriteBackEviction::CleanOnly);
+        cache.put(1, 1);
+        cache.put(2, 2);
+        cache.put(3, 3);
+        cache.flushDirty();
+        writes = 0;
+
+        assert(cache.markDirty(1) == true);
+        assert(cache.markDirty(4) == false);
+        cache.put(4, 4);
+        assert(writes == 0);
+        assert(cache.contains(1) == true);
+        assert(cache.contains(2) == false);
+    }
+
+    {
+        // test dirty tracking is charged to its own counters, not to the recency lists
+        LFUCache<int, int> cache(4);
+        cache.setWriteBack([](const int&, const int&) {});
+        cache.put(1, 1);
+        cache.put(2, 2);
+        cache.put(3, 3);
+
+        MemoryUsage usage = cache.memoryUsage();
+        assert(usage.listNodes.blocks == cache.size());
+        assert(usage.dirtyNodes.blocks == 2 * cache.dirtyCount()); // queue node and index node per entry
+        assert(usage.dirtyBuckets.bytes > 0);
+
+        cache.flushDirty();
+        usage = cache.memoryUsage();
+        assert(usage.dirtyNodes.blocks == 0);
+        assert(usage.listNodes.blocks == cache.size());
+    }
+
+    {
+        // test the write-back wrapper batches to a file sink and loses nothing, evicted or not
+        auto path = std::filesystem::temp_directory_path() / "lfu_cache_write_back_test.log";
+        std::filesystem::remove(path);
+        {
+            WriteBackCache<int, int>::Options options;
+            options.batchSize = 8;
+            options.interval = std::chrono::milliseconds(1);
+            WriteBackCache<int, int> cache(4, FileSink<int, int>(path.string()), options);
+            for (int i = 0; i < 1000; ++i) {
+                cache.put(i % 10, i);
+            }
+            assert(cache.get(9).value() == 999);
+            assert(cache.get(42).has_value() == false);
+        }
+
+        std::ifstream in(path);
+        std::map<int, int> store;
+        int key, val, lines = 0;
+        while (in >> key >> val) {
+            store[key] = val;
+            lines += 1;
+        }
+        assert(store.size() == 10);
+        for (const auto& [k, v] : store) {
+            assert(v == 990 + k);
+        }
+        assert(lines <= 1000);
+        std::filesystem::remove(path);
+    }
+
+    {
+        // test a batch the sink throws on is retried rather than lost, and the failure is reported
+        std::mutex storeMutex;
+        std::map<int, int> store;
+        int calls = 0;
+        std::atomic<int> errors {0};
+        {
+            WriteBackCache<int, int>::Options options;
+            options.batchSize = 4;
+            options.interval = std::chrono::milliseconds(1);
+            options.onError = [&](std::exception_ptr) { errors += 1; };
+            WriteBackCache<int, int> cache(2, [&](const WriteBackCache<int, int>::Batch& batch) {
+                std::lock_guard<std::mutex> lock(storeMutex);
+                if (++calls <= 3) {
+                    throw std::runtime_error("store down");
+                }
+                for (const auto& [key, val] : batch) {
+                    store[key] = val;
+                }
+            }, options);
+            for (int i = 0; i < 100; ++i) {
+                cache.put(i % 20, i);
+            }
+            assert(cache.get(0).value() == 80); // evicted, still queued or written
+            while (errors < 3) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            assert(cache.sinkFailures() >= 3);
+        }
+        assert(store.size() == 20);
+        for (const auto& [key, val] : store) {
+            assert(val == 80 + key);
+        }
+    }
+
+    {
+        // test put() waits for the flusher once maxPending victims queue up for a slow store
+        WriteBackCache<int, int>::Options options;
+        options.batchSize = 4;
+        options.maxPending = 8;
+        options.interval = std::chrono::milliseconds(1);
+        WriteBackCache<int, int> cache(2, [](const WriteBackCache<int, int>::Batch&) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }, options);
+        for (int i = 0; i < 500; ++i) {
+            cache.put(i, i);
+            assert(cache.dirtyCount() <= 8 + 2);
+        }
+    }
+
+    {
+        // test the sharded cache splits capacity over a power of two of shards and finds keys across them
+        ShardedLFUCache<std::string, int> cache(100, 3);
+        assert(cache.shardCount() == 4);
+        for (int i = 0; i < 50; ++i) {
+            cache.put("key" + std::to_string(i), i);
+        }
+        assert(cache.size() == 50);
+        assert(cache.get(std::string_view("key7")).value() == 7);
+        assert(cache.get("missing").has_value() == false);
+
+        int seen = -1;
+        assert(cache.find("key9", [&](int& val) { seen = val; val = 90; }) == true);
+        assert(seen == 9 && cache.get("key9").value() == 90);
+        assert(cache.erase("key9") == true);
+        assert(cache.erase("key9") == false);
+
+        size_t total = 0;
+        cache.forEachShard([&](auto& shard) { total += shard.size(); });
+        assert(total == 49);
+
+        // batched lookups report hits by position, whichever shard each key lives in
+        std::vector<std::string_view> keys {"key1", "missing", "key30", "key1"};
+        std::vector<int> found(keys.size(), -1);
+        cache.findMany(std::span<const std::string_view>(keys), [&](size_t i, int& val) { found[i] = val; });
+        assert((found == std::vector<int> {1, -1, 30, 1}));
+    }
+
+    {
+        // test shards evict on their own once the keys of one shard outgrow its share
+        ShardedLFUCache<int, int> cache(8, 2);
+        for (int i = 0; i < 100; ++i) {
+            cache.put(i, i);
+        }
+        assert(cache.size() <= 8);
+
+        // the shard capacities add up to the capacity asked for, with fewer shards than keys it would need
+        ShardedLFUCache<int, int> small(3, 16);
+        assert(small.shardCount() == 2 && small.capacity() == 3);
+        ShardedLFUCache<int, int> uneven(10, 4);
+        for (int i = 0; i < 1000; ++i) {
+            small.put(i, i);
+            uneven.put(i, i);
+        }
+        assert(small.size() == 3 && uneven.size() == 10);
+    }
+
+    {
+        // test an arena backed cache reuses freed blocks instead of mapping more
+        Arena arena;
+        LFUCache<int, int, std::hash<int>, std::equal_to<int>, ArenaAllocator<std::pair<const int, int>>> cache(
+            1000, std::hash<int>(), std::equal_to<int>(), ArenaAllocator<std::pair<const int, int>>(arena));
+        for (int i = 0; i < 1000; ++i) {
+            cache.put(i, i);
+        }
+        size_t reserved = arena.reservedBytes();
+        for (int i = 1000; i < 100000; ++i) {
+            cache.put(i, i);
+        }
+        assert(arena.reservedBytes() == reserved);
+        assert(cache.get(99999) == 99999);
+    }
+
+    {
+        // test a huge page arena maps whole, aligned huge pages whether or not the kernel has any to give
+        Arena arena(Arena::Options {.hugePages = true});
+        void* first = arena.allocate(16);
+        assert(reinterpret_cast<uintptr_t>(first) % Arena::HugePageSize == 0);
+        arena.deallocate(first, 16);
+
+        LFUCache<int, int, std::hash<int>, std::equal_to<int>, ArenaAllocator<std::pair<const int, int>>> cache(
+            100000, std::hash<int>(), std::equal_to<int>(), ArenaAllocator<std::pair<const int, int>>(arena));
+        for (int i = 0; i < 200000; ++i) {
+            cache.put(i, i);
+        }
+        assert(cache.size() == 100000 && cache.get(199999) == 199999);
+        assert(arena.reservedBytes() % Arena::HugePageSize == 0);
+        assert(arena.hugeTlbBytes() <= arena.reservedBytes());
+    }
+
+    {
+        // test the NUMA cache keeps one home copy per key and copies hot keys to the nodes reading them
+        NumaLFUCache<std::string, int>::Options options;
+        options.nodes = 2;
+        options.shardsPerNode = 2;
+        options.replicaCapacity = 16;
+        options.replicaMinFreq = 3;
+        NumaLFUCache<std::string, int> cache(100, options);
+        assert(cache.nodeCount() == 2 && cache.shardCount() == 4 && cache.capacity() == 100);
+        NumaLFUCache<std::string, int> small(3, options);
+        assert(small.shardCount() == 2 && small.capacity() == 3);
+        for (int i = 0; i < 100; ++i) {
+            small.put(std::to_string(i), i);
+        }
+        assert(small.size() == 3);
+        bool threw = false;
+        try {
+            NumaLFUCache<std::string, int> tiny(1, options);
+        } catch (const std::invalid_argument&) {
+            threw = true; // every node needs a shard of at least one key
+        }
+        assert(threw);
+        for (int i = 0; i < 20; ++i) {
+            cache.put("key" + std::to_string(i), i);
+        }
+        assert(cache.size() == 20);
+
+        auto onNode = [](int node, auto fn) {
+            std::thread([&] {
+                NumaTopology::bindThread(node);
+                fn();
+            }).join();
+        };
+        int home = cache.homeNodeOf("key1");
+        int other = 1 - home;
+        onNode(home, [&] {
+            for (int i = 0; i < 5; ++i) {
+                assert(cache.get("key1").value() == 1);
+            }
+        });
+        assert(cache.replicaSize(home) == 0);
+        onNode(other, [&] {
+            assert(cache.get("key1").value() == 1);
+            assert(cache.replicaSize(other) == 1);
+            assert(cache.get("missing").has_value() == false);
+        });
+
+        // writes drop the copies, the next remote read sees the new value
+        cache.put("key1", 100);
+        assert(cache.replicaSize(other) == 0);
+        onNode(other, [&] { assert(cache.get(std::string_view("key1")).value() == 100); });
+        assert(cache.erase("key1") == true);
+        onNode(other, [&] { assert(cache.get("key1").has_value() == false); });
+    }
+
+    {
+        // test the compact cache evicts exactly like LFUCache under a random mix of operations
+        LFUCache<int, int> reference(64);
+        CompactLFUCache<int, int> compact(64);
+        uint64_t state = 12345;
+        auto next = [&state] {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            return static_cast<int>(state >> 33);
+        };
+        for (int i = 0; i < 200000; ++i) {
+            int key = next() % 200;
+            switch (next() % 4) {
+            case 0:
+                reference.put(key, i);
+                compact.put(key, i);
+                break;
+            case 1:
+                assert(reference.erase(key) == compact.erase(key));
+                break;
+            default: {
+                int* expected = reference.find(key);
+                int* found = compact.find(key);
+                assert((expected == nullptr) == (found == nullptr));
+                assert(expected == nullptr || *expected == *found);
+            }
+            }
+        }
+        assert(reference.size() == compact.size());
+        for (int key = 0; key < 200; ++key) {
+            assert(reference.contains(key) == compact.contains(key));
+        }
+    }
+
+    {
+        // test the compact cache destroys what it evicts and erases, and looks strings up by view
+        CompactLFUCache<std::string, std::unique_ptr<int>> cache(2);
+        cache.put("a", std::make_unique<int>(1));
+        cache.put(std::string("b"), std::make_unique<int>(2));
+        assert(**cache.find(std::string_view("a")) == 1);
+        assert(cache.frequency("a") == 2 && cache.frequency("b") == 1);
+        cache.put("c", std::make_unique<int>(3));
+        assert(cache.contains("b") == false && cache.size() == 2);
+        assert(**cache.peek("c") == 3 && cache.frequency("c") == 1);
+        assert(cache.erase("a") == true && cache.erase("a") == false);
+
+        CompactLFUCache<std::string, std::unique_ptr<int>> moved(std::move(cache));
+        assert(moved.size() == 1 && **moved.find("c") == 3);
+        assert(moved.memoryBytes() > 0);
+    }
+
+    {
+        // test a throwing value constructor leaves no half built entry in the compact cache
+        struct Picky {
+            Picky(int v) : v(v) {
+                if (v < 0) {
+                    throw std::runtime_error("negative");
+                }
+            }
+            int v;
+        };
+        CompactLFUCache<int, Picky> cache(2);
+        cache.put(1, 1);
+        bool threw = false;
+        try {
+            cache.put(2, -2);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw && cache.size() == 1 && cache.contains(2) == false);
+        cache.put(2, 2);
+        cache.put(3, 3);
+        assert(cache.size() == 2 && cache.contains(1) == false && cache.peek(3)->v == 3);
+    }
+
+    {
+        // test the sampled cache keeps its index right while slots move to fill holes
+        SampledLFUCache<int, std::string> cache(50, 8);
+        std::map<int, std::string> model;
+        uint64_t state = 777;
+        auto next = [&state] {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            return static_cast<int>(state >> 33);
+        };
+        for (int i = 0; i < 100000; ++i) {
+            int key = next() % 120;
+            if (next() % 3 == 0) {
+                cache.erase(key);
+                model.erase(key);
+            } else {
+                std::string val = std::to_string(i);
+                cache.put(key, val);
+                model[key] = val;
+            }
+        }
+        size_t cached = 0;
+        for (const auto& [key, val] : model) {
+            if (const std::string* found = cache.peek(key)) {
+                assert(*found == val);
+                cached += 1;
+            }
+        }
+        assert(cached == cache.size() && cache.size() <= 50);
+    }
+
+    {
+        // test sampled eviction keeps the frequently used keys
+        SampledLFUCache<int, int> cache(100, 16);
+        for (int i = 0; i < 10; ++i) {
+            cache.put(i, i);
+            for (int j = 0; j < 5; ++j) {
+                cache.find(i);
+            }
+        }
+        for (int i = 10; i < 10000; ++i) {
+            cache.put(i, i);
+        }
+        for (int i = 0; i < 10; ++i) {
+            assert(cache.frequency(i) == 6);
+        }
+        assert(cache.size() == 100);
+
+        SampledLFUCache<int, int, std::hash<int>, std::equal_to<int>, uint8_t> small(10, 4);
+        for (int i = 0; i < 300; ++i) {
+            small.put(1, i);
+        }
+        assert(small.frequency(1) == 255);
+    }
+
+    {
+        // test a window as wide as the cache finds the exact victim wherever it starts and wraps
+        SampledLFUCache<int, int> cache(4, 4);
+        for (int round = 0; round < 20; ++round) {
+            for (int i = 0; i < 4; ++i) {
+                cache.erase(i);
+            }
+            cache.erase(100);
+            for (int i = 0; i < 4; ++i) {
+                cache.put(i, i);
+            }
+            int victim = round % 4;
+            for (int i = 0; i < 4; ++i) {
+                if (i != victim) {
+                    cache.find(i);
+                }
+            }
+            cache.put(100, 100);
+            assert(cache.contains(victim) == false && cache.size() == 4);
+        }
+
+        // test a throwing value constructor leaves neither a slot nor its key behind
+        struct Picky {
+            Picky(int v) : v(v) {
+                if (v < 0) {
+                    throw std::runtime_error("negative");
+                }
+            }
+            int v;
+        };
+        SampledLFUCache<std::string, Picky> picky(2, 2);
+        picky.put(std::string(40, 'a'), 1);
+        bool threw = false;
+        try {
+            picky.put(std::string(40, 'b'), -1);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw && picky.size() == 1 && picky.contains(std::string(40, 'b')) == false);
+        picky.put(std::string(40, 'b'), 2);
+        assert(picky.size() == 2 && picky.peek(std::string(40, 'b'))->v == 2);
+    }
+
+    {
+        // test evict() on its own moves on to the next frequency when it empties the lowest one
+        LFUCache<int, int> cache(3);
+        cache.put(1, 1);
+        cache.put(2, 2);
+        cache.touch(2);
+        cache.put(3, 3);
+        cache.touch(3);
+        cache.touch(3);
+        cache.evict();
+        assert(cache.contains(1) == false);
+        cache.evict();
+        assert(cache.contains(2) == false);
+        cache.evict();
+        cache.evict();
+        assert(cache.empty());
+    }
+
+    {
+        // test erase() and evict() step over frequency gaps to the next lowest list, however far up it is
+        LFUCache<int, int> cache(4);
+        cache.put(1, 1);
+        cache.put(2, 2);
+        cache.put(3, 3);
+        for (int i = 0; i < 1000; ++i) {
+            cache.touch(2);
+        }
+        for (int i = 0; i < 500; ++i) {
+            cache.touch(3);
+        }
+        assert(cache.erase(1) == true);
+        assert(cache.freqDistribution().front().freq == 501); // 3 is next in line now
+        cache.evict();
+        assert(cache.contains(3) == false && cache.contains(2) == true);
+        cache.put(4, 4);
+        cache.put(5, 5);
+        cache.evict();
+        cache.evict();
+        assert(cache.size() == 1 && cache.contains(2) == true);
+        cache.touch(2);
+        assert(cache.hottestKeys(1)[0].second == 1002);
+    }
+
+    {
+        // test a full cache evicts down to the low watermark in one go, across frequencies, in eviction order
+        LFUCache<int, int> cache(6);
+        std::vector<int> evicted;
+        cache.setRemovalListener([&](int&& key, int&&, RemovalCause) { evicted.push_back(key); });
+        assert(cache.lowWatermark() == 5);
+        cache.setLowWatermark(2);
+        for (int i = 1; i <= 6; ++i) {
+            cache.put(i, i);
+        }
+        cache.touch(1);
+        cache.touch(2);
+        cache.touch(2);
+        cache.touch(5);
+        cache.put(7, 7);
+        assert((evicted == std::vector<int> {3, 4, 6, 1}));
+        assert(cache.size() == 3);
+        assert(cache.contains(2) && cache.contains(5) && cache.contains(7));
+
+        // and the inserts up to capacity evict nothing
+        cache.put(8, 8);
+        cache.put(9, 9);
+        cache.put(10, 10);
+        assert(evicted.size() == 4 && cache.size() == 6);
+
+        assert(cache.evictTo(4) == 2);
+        assert(cache.evictTo(4) == 0);
+        assert(cache.size() == 4);
+        assert(cache.evictTo(0) == 4);
+        assert(cache.empty());
+
+        bool threw = false;
+        try {
+            cache.setLowWatermark(6);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+    {
+        // test a batch writes every dirty victim before dropping it
+        LFUCache<int, int> cache(8);
+        std::vector<int> written;
+        cache.setWriteBack([&](const int& key, const int&) { written.push_back(key); });
+        cache.setLowWatermark(4);
+        for (int i = 0; i < 9; ++i) {
+            cache.put(i, i);
+        }
+        assert((written == std::vector<int> {0, 1, 2, 3}));
+        assert(cache.size() == 5 && cache.dirtyCount() == 5);
+    }
+
+    {
+        // test victim selection takes the lowest frequency, then the oldest, then the first index
+        uint16_t freqs[] {3, 1, 2, 1, 1};
+        uint32_t stamps[] {10, 12, 5, 11, 13};
+        assert(victim_select::scalar(freqs, stamps, 5, 20) == 3);
+        uint32_t wrapped[] {10, UINT32_MAX - 1, 5, 2, 1};
+        assert(victim_select::scalar(freqs, wrapped, 5, 3) == 1);
+
+        // and every SIMD kernel the cpu runs agrees with the scalar one on every window length
+        auto check = [](auto counter) {
+            using Counter = decltype(counter);
+            std::vector<victim_select::Kernel<Counter>> kernels {&victim_select::select<Counter>};
+#ifdef LFU_CACHE_X86_KERNELS
+            if (__builtin_cpu_supports("sse4.1")) {
+                kernels.push_back(&victim_select::sse41<Counter>);
+            }
+            if (__builtin_cpu_supports("avx2")) {
+                kernels.push_back(&victim_select::avx2<Counter>);
+            }
+#endif
+            uint64_t state = 99;
+            auto next = [&state] {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                return static_cast<uint32_t>(state >> 33);
+            };
+            std::vector<Counter> freqs(130);
+            std::vector<uint32_t> stamps(130);
+            for (int round = 0; round < 2000; ++round) {
+                uint32_t count = 1 + next() % 130;
+                uint32_t clock = next();
+                for (uint32_t i = 0; i < count; ++i) {
+                    // few distinct values, so that ties on frequency and on age are common
+                    freqs[i] = static_cast<Counter>(round % 2 ? next() % 4 : next());
+                    stamps[i] = clock - next() % 8;
+                }
+                uint32_t expected = victim_select::scalar(freqs.data(), stamps.data(), count, clock);
+                for (auto kernel : kernels) {
+                    assert(kernel(freqs.data(), stamps.data(), count, clock) == expected);
+                }
+            }
+        };
+        check(uint8_t());
+        check(uint16_t());
+    }
+
+#if defined(__linux__)
+    {
+        // test two processes share one cache through a shared memory segment
+        std::string name = "/lfu_cache_test_" + std::to_string(getpid());
+        SharedLFUCache<int, int>::remove(name);
+        SharedLFUCache<int, int> cache(name, 3);
+        cache.put(1, 10);
+
+        pid_t child = fork();
+        if (child == 0) {
+            SharedLFUCache<int, int> other(name, 3);
+            bool ok = other.get(1) == 10;
+            other.put(2, 20);
+            other.put(3, 30);
+            ok = ok && other.get(3) == 30 && other.size() == 3;
+            _exit(ok ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+        // 1 and 3 have been used twice, 2 only once
+        assert(cache.size() == 3);
+        cache.put(4, 40);
+        assert(cache.contains(2) == false);
+        assert(cache.get(3).value() == 30);
+
+        // the least recently used of the lowest frequency goes first
+        assert(cache.get(4).value() == 40);
+        cache.put(5, 50);
+        assert(cache.contains(1) == false);
+        assert(cache.erase(5) == true && cache.erase(5) == false);
+        assert(cache.size() == 2);
+
+        bool threw = false;
+        try {
+            SharedLFUCache<int, int> wrong(name, 4);
+        } catch (const std::invalid_argument&) {
+            threw = true;
+        }
+        assert(threw);
+        SharedLFUCache<int, int>::remove(name);
+    }
+
+    {
+        // test the shared cache keeps LFU order over many keys and frees nodes as frequencies empty
+        std::string name = "/lfu_cache_test_lfu_" + std::to_string(getpid());
+        SharedLFUCache<int, int>::remove(name);
+        SharedLFUCache<int, int> cache(name, 100);
+        for (int i = 0; i < 100; ++i) {
+            cache.put(i, i);
+            for (int j = 0; j < i % 7; ++j) {
+                cache.get(i);
+            }
+        }
+        for (int i = 100; i < 1000; ++i) {
+            cache.put(i, i);
+        }
+        // the new keys keep evicting each other, the most used of the first ones stay
+        for (int i = 0; i < 100; ++i) {
+            assert(cache.contains(i) == (i % 7 != 0));
+        }
+        SharedLFUCache<int, int>::remove(name);
+    }
+
+    {
+        // test a key alone at its frequency moves up with every frequency node already taken
+        std::string name = "/lfu_cache_test_full_" + std::to_string(getpid());
+        SharedLFUCache<int, int>::remove(name);
+        SharedLFUCache<int, int> cache(name, 2);
+        cache.put(1, 1);
+        cache.put(2, 2);
+        assert(cache.get(2).value() == 2);
+        assert(cache.get(2).value() == 2);
+        assert(cache.get(1).value() == 1);
+        cache.put(3, 3); // 1 was used twice, 2 three times
+        assert(cache.contains(1) == false && cache.contains(2) == true && cache.contains(3) == true);
+        SharedLFUCache<int, int>::remove(name);
+    }
+#endif
 }
@@ -0,0 +1,941 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <unordered_map>
+#include <limits>
+#include <list>
+#include <concepts>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "CountingAllocator.h"
+
+#include "LatencyHistogram.h"
+#include "LFUCacheProbes.h"
+
+template<typename T>
+concept DefaultContructible = std::is_default_constructible<T>::value;
+
+// small trivially copyable types are passed in registers, everything else by const reference
+template<typename T>
+concept PassByValue = std::is_trivially_copyable_v<T> && sizeof(T) <= 2 * sizeof(void*);
+
+template<typename T>
+using ParamType = std::conditional_t<PassByValue<T>, T, const T&>;
+
+// transparent hash so string keyed caches can be probed with std::string_view or const char*
+// without building a std::string, same hash values as std::hash<std::string>
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view key) const noexcept {
+        return std::hash<std::string_view>()(key);
+    }
+};
+
+// std::string keys get transparent hashing and equality by default, other keys the std functors
+template<typename K>
+using DefaultHash = std::conditional_t<std::is_same_v<K, std::string>, StringHash, std::hash<K>>;
+
+template<typename K>
+using DefaultKeyEqual = std::conditional_t<std::is_same_v<K, std::string>, std::equal_to<>, std::equal_to<K>>;
+
+// heap bytes currently held by each structure of the cache, as requested from the allocator
+// (malloc's own per block overhead comes on top, blocks counts how many allocations are live)
+struct MemoryUsage {
+    MemoryCounter indexNodes;   // [key, hash] -> KeyMeta nodes, one per entry
+    MemoryCounter indexBuckets; // bucket array of the key index
+    MemoryCounter listNodes;    // recency list nodes, one per entry, each pointing at its index node
+    MemoryCounter freqNodes;    // freq -> list nodes, one per distinct frequency ever seen
+    MemoryCounter freqBuckets;  // bucket array of the freq map
+    MemoryCounter dirtyNodes;   // write-back queue and dirty index nodes, two per dirty entry
+    MemoryCounter dirtyBuckets; // bucket array of the dirty index
+
+    size_t total() const {
+        return indexNodes.bytes + indexBuckets.bytes + listNodes.bytes + freqNodes.bytes + freqBuckets.bytes
+               + dirtyNodes.bytes + dirtyBuckets.bytes;
+    }
+};
+
+// why an entry left the cache, as reported to the removal listener
+enum class RemovalCause {
+    Size,     // evicted to make room for a new key, or by evict()
+    Expired,  // reserved for time based expiry, the cache does not expire entries yet
+    Explicit, // removed by erase()
+    Replaced, // value overwritten by put() / insertOrAssign()
+};
+
+// Immediate calls the listener from inside the operation that removed the entry. Deferred queues the removals
+// until takeRemovals() / flushRemovals(), so a slow listener can run outside the lock guarding the cache
+enum class RemovalDelivery { Immediate, Deferred };
+
+// what evict() does in write-back mode when the least frequently used key is dirty. FlushVictim writes it
+// and drops it, CleanOnly takes the first clean key among the next few from the tail of the min freq list
+// instead and only writes a dirty victim when they are all dirty
+enum class WriteBackEviction { FlushVictim, CleanOnly };
+
+// key as stored in the index, together with its hash computed once when the entry was created.
+// growing the index and erasing evicted entries read the stored hash instead of hashing the key again
+template<typename K>
+struct HashedKey {
+    K key;
+    size_t hash;
+};
+
+// lookup key with an already computed hash, Q is the key type or a heterogeneous key type
+template<typename Q>
+struct HashedRef {
+    const Q& key;
+    size_t hash;
+};
+
+template<typename K, typename V, typename Hash = DefaultHash<K>, typename KeyEqual = DefaultKeyEqual<K>,
+         typename Alloc = std::allocator<std::pair<const K, V>>>
+class LFUCache {
+private:
+    // every structure allocates through its own counters so memoryUsage() can split the bytes
+    template<typename T>
+    using CountingAlloc = CountingAllocator<T, typename std::allocator_traits<Alloc>::template rebind_alloc<T>>;
+
+    struct KeyMeta;
+    using IndexKey = HashedKey<K>;
+    using Entry = std::pair<const IndexKey, KeyMeta>;
+    using KeyList = std::list<Entry*, CountingAlloc<Entry*>>; // index nodes never move, so lists point at them
+    using LstIter = KeyList::iterator;
+    using KeyParam = ParamType<K>;
+
+    // lookups accept other key types as is when hash and equality are both transparent
+    template<typename Q>
+    static constexpr bool IsHeterogeneousKey = !std::is_same_v<std::remove_cvref_t<Q>, K>
+        && requires { typename Hash::is_transparent; typename KeyEqual::is_transparent; }
+        && std::is_invocable_r_v<size_t, const Hash&, const Q&>
+        && std::is_invocable_r_v<bool, const KeyEqual&, const K&, const Q&>;
+
+    template<typename Q>
+    static constexpr bool IsLookupKey = std::is_same_v<std::remove_cvref_t<Q>, K> || IsHeterogeneousKey<Q>;
+
+    struct KeyMeta {
+        LstIter iter;
+        int freq;
+        V val;
+#ifdef LFU_CACHE_ENTRY_AGE
+        uint64_t lastAccess = 0; // value of mClock when key was inserted or last touched
+#endif
+
+        template<typename... VArgs>
+        KeyMeta(std::in_place_t, VArgs&&... valArgs) : iter(), freq(1), val(std::forward<VArgs>(valArgs)...) {}
+    };
+
+    // keys at one frequency, the head is the key most recently used, the tail the least recently used.
+    // lists that have keys are chained in ascending frequency order, so the next frequency up or down is a
+    // pointer away. a list that runs dry is unlinked but stays in mKeysByFreq for the next key to reach it
+    struct FreqList {
+        KeyList keys;
+        int freq;
+        FreqList* lower = nullptr;
+        FreqList* higher = nullptr;
+
+        FreqList(int freq, const CountingAlloc<Entry*>& alloc) : keys(alloc), freq(freq) {}
+    };
+
+    static constexpr size_t CleanVictimScan = 16; // keys CleanOnly looks at before writing a dirty victim
+
+    // the index hashes and compares through the stored hash, the user's Hash only runs once per call
+    struct IndexHash {
+        using is_transparent = void;
+        [[no_unique_address]] Hash hash;
+
+        size_t operator()(const IndexKey& key) const noexcept {
+            return key.hash;
+        }
+
+        template<typename Q>
+        size_t operator()(const HashedRef<Q>& ref) const noexcept {
+            return ref.hash;
+        }
+    };
+
+    struct IndexEqual {
+        using is_transparent = void;
+        [[no_unique_address]] KeyEqual equal;
+
+        bool operator()(const IndexKey& a, const IndexKey& b) const {
+            return a.hash == b.hash && equal(a.key, b.key);
+        }
+
+        template<typename Q>
+        bool operator()(const HashedRef<Q>& a, const IndexKey& b) const {
+            return a.hash == b.hash && equal(b.key, a.key);
+        }
+
+        template<typename Q>
+        bool operator()(const IndexKey& a, const HashedRef<Q>& b) const {
+            return a.hash == b.hash && equal(a.key, b.key);
+        }
+    };
+
+    size_t mCapacity;
+    size_t mLowWatermark; // a full cache evicts down to this many keys
+    FreqList* mLowest = nullptr; // list at the minimum frequency of all keys, nullptr while empty
+    FreqList* mHighest = nullptr; // list at the maximum frequency of all keys
+#ifdef LFU_CACHE_ENTRY_AGE
+    uint64_t mClock = 0; // logical clock, ticks once per insert or touch, only compiled in with LFU_CACHE_ENTRY_AGE
+#endif
+    struct Counters {
+        StructureCounters index;
+        StructureCounters lists;
+        StructureCounters freqs;
+        StructureCounters dirty;
+    };
+    std::unique_ptr<Counters> mCounters; // on the heap so allocators keep pointing at it when the cache moves
+
+    std::unordered_map<int, FreqList, std::hash<int>, std::equal_to<int>,
+                       CountingAlloc<std::pair<const int, FreqList>>> mKeysByFreq; // freq -> list of entries
+    std::unordered_map<IndexKey, KeyMeta, IndexHash, IndexEqual,
+                       CountingAlloc<Entry>> mKeyMetaByKey; // [key, hash] -> [iterator to entry's pos in list, freq, value]
+    KeyList mDirtyKeys; // dirty entries in the order they became dirty
+    // dirty entry -> its node in mDirtyKeys. kept outside KeyMeta so entries pay nothing for write-back mode
+    // unless it is on, and empty while it is off
+    std::unordered_map<const Entry*, LstIter, std::hash<const Entry*>, std::equal_to<const Entry*>,
+                       CountingAlloc<std::pair<const Entry* const, LstIter>>> mDirtyIndex;
+#ifdef LFU_CACHE_LATENCY
+    LatencyStats mLatency; // per operation latency in ticks, only compiled in with LFU_CACHE_LATENCY
+#endif
+
+public:
+    struct FreqBucket {
+        int freq;
+        size_t count; // number of keys currently at freq
+    };
+
+    struct Removal {
+        K key;
+        V val;
+        RemovalCause cause;
+    };
+
+    // receives the removed key and value by move
+    using RemovalListener = std::function<void(K&&, V&&, RemovalCause)>;
+
+    // persists one entry to the backing store in write-back mode
+    using DirtyWriter = std::function<void(const K&, const V&)>;
+
+private:
+    RemovalListener mRemovalListener;
+    RemovalDelivery mRemovalDelivery = RemovalDelivery::Immediate;
+    std::vector<Removal> mPendingRemovals; // removals not yet delivered in Deferred mode
+    DirtyWriter mDirtyWriter; // set in write-back mode
+    WriteBackEviction mWriteBackEviction = WriteBackEviction::FlushVictim;
+
+public:
+
+    LFUCache(size_t capacity, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(),
+             const Alloc& alloc = Alloc())
+        : mCapacity(capacity),
+          mLowWatermark(capacity - 1),
+          mCounters(std::make_unique<Counters>()),
+          mKeysByFreq(0, std::hash<int>(), std::equal_to<int>(), CountingAlloc<std::pair<const int, FreqList>>(&mCounters->freqs, alloc)),
+          mKeyMetaByKey(0, IndexHash {hash}, IndexEqual {equal}, CountingAlloc<Entry>(&mCounters->index, alloc)),
+          mDirtyKeys(CountingAlloc<Entry*>(&mCounters->dirty, alloc)),
+          mDirtyIndex(0, std::hash<const Entry*>(), std::equal_to<const Entry*>(),
+                      CountingAlloc<std::pair<const Entry* const, LstIter>>(&mCounters->dirty, alloc)) {
+        if (capacity <= 0) {
+            throw std::invalid_argument ("Capacity cannot be less than or equal to zero.");
+        }
+        // the index never holds more than capacity keys, so sizing its buckets now means no put() ever
+        // stalls rehashing the whole index the way growing it on demand would
+        mKeyMetaByKey.reserve(capacity);
+    }
+    ~LFUCache() = default;
+
+    // moves take the entries, counters, listener and writer along. the moved-from cache is left empty and
+    // usable with counters of its own. a cache assigned over drops its entries without listener or writer.
+    // there is no copy: the lists hold iterators into the index
+    LFUCache(LFUCache&& other)
+        : mCapacity(other.mCapacity),
+          mLowWatermark(other.mLowWatermark),
+          mLowest(std::exchange(other.mLowest, nullptr)),
+          mHighest(std::exchange(other.mHighest, nullptr)),
+#ifdef LFU_CACHE_ENTRY_AGE
+          mClock(other.mClock),
+#endif
+          mCounters(std::move(other.mCounters)),
+          mKeysByFreq(std::move(other.mKeysByFreq)),
+          mKeyMetaByKey(std::move(other.mKeyMetaByKey)),
+          mDirtyKeys(std::move(other.mDirtyKeys)),
+          mDirtyIndex(std::move(other.mDirtyIndex)),
+#ifdef LFU_CACHE_LATENCY
+          mLatency(std::move(other.mLatency)),
+#endif
+          mRemovalListener(std::move(other.mRemovalListener)),
+          mRemovalDelivery(other.mRemovalDelivery),
+          mPendingRemovals(std::move(other.mPendingRemovals)),
+          mDirtyWriter(std::move(other.mDirtyWriter)),
+          mWriteBackEviction(other.mWriteBackEviction) {
+        other.resetAfterMove();
+    }
+
+    LFUCache& operator=(LFUCache&& other) {
+        if (this == &other) {
+            return *this;
+        }
+        // the containers free their old nodes through allocators charging the old counters, so the counters
+        // are replaced only after every container has taken over the other cache's structures
+        mKeysByFreq = std::move(other.mKeysByFreq);
+        mKeyMetaByKey = std::move(other.mKeyMetaByKey);
+        mDirtyKeys = std::move(other.mDirtyKeys);
+        mDirtyIndex = std::move(other.mDirtyIndex);
+        mCounters = std::move(other.mCounters);
+
+        mCapacity = other.mCapacity;
+        mLowWatermark = other.mLowWatermark;
+        mLowest = std::exchange(other.mLowest, nullptr);
+        mHighest = std::exchange(other.mHighest, nullptr);
+#ifdef LFU_CACHE_ENTRY_AGE
+        mClock = other.mClock;
+#endif
+#ifdef LFU_CACHE_LATENCY
+        mLatency = std::move(other.mLatency);
+#endif
+        mRemovalListener = std::move(other.mRemovalListener);
+        mRemovalDelivery = other.mRemovalDelivery;
+        mPendingRemovals = std::move(other.mPendingRemovals);
+        mDirtyWriter = std::move(other.mDirtyWriter);
+        mWriteBackEviction = other.mWriteBackEviction;
+        other.resetAfterMove();
+        return *this;
+    }
+
+    // the hash the cache uses for key, callers that need it anyway (e.g. to pick a shard)
+    // can hand it back to the *Hashed calls and save hashing the key twice
+    template<typename Q>
+        requires IsLookupKey<Q>
+    size_t hashOf(const Q& key) const {
+        return mKeyMetaByKey.hash_function().hash(key);
+    }
+
+    bool contains(KeyParam key) const {
+        return lookup(key, hashOf(key)) != mKeyMetaByKey.end();
+    }
+
+    template<typename Q>
+        requires IsHeterogeneousKey<Q>
+    bool contains(const Q& key) const {
+        return lookup(key, hashOf(key)) != mKeyMetaByKey.end();
+    }
+
+    bool empty() const {
+        return mKeyMetaByKey.empty();
+    }
+
+    size_t size() const {
+        return mKeyMetaByKey.size();
+    }
+
+    // count of keys per frequency in ascending frequency order, walks the chain of non-empty lists
+    // from the bottom and list sizes are O(1), so this costs one step per distinct frequency in use
+    std::vector<FreqBucket> freqDistribution() const {
+        std::vector<FreqBucket> buckets;
+        for (const FreqList* list = mLowest; list != nullptr; list = list->higher) {
+            buckets.push_back({list->freq, list->keys.size()});
+        }
+        return buckets;
+    }
+
+    // up to k keys with the highest frequency, most recently used first among equal frequencies,
+    // walks the chain of non-empty lists from the top and stops as soon as k keys are collected
+    std::vector<std::pair<K, int>> hottestKeys(size_t k) const {
+        std::vector<std::pair<K, int>> hottest;
+        for (const FreqList* list = mHighest; list != nullptr && hottest.size() < k; list = list->lower) {
+            for (const Entry* entry : list->keys) {
+                if (hottest.size() == k) {
+                    break;
+                }
+                hottest.emplace_back(entry->first.key, list->freq);
+            }
+        }
+        return hottest;
+    }
+
+    MemoryUsage memoryUsage() const {
+        return MemoryUsage {
+            mCounters->index.nodes,
+            mCounters->index.buckets,
+            mCounters->lists.nodes,
+            mCounters->freqs.nodes,
+            mCounters->freqs.buckets,
+            mCounters->dirty.nodes,
+            mCounters->dirty.buckets,
+        };
+    }
+
+#ifdef LFU_CACHE_ENTRY_AGE
+    // number of inserts and touches since the next eviction victim (tail of the min freq list) was last used
+    uint64_t oldestMinFreqAge() const {
+        if (mLowest == nullptr) {
+            return 0;
+        }
+        return mClock - mLowest->keys.back()->second.lastAccess;
+    }
+#endif
+
+#ifdef LFU_CACHE_LATENCY
+    const LatencyStats& latencyStats() const {
+        return mLatency;
+    }
+
+    void resetLatencyStats() {
+        mLatency.reset();
+    }
+
+    void setLatencySamplePeriod(uint32_t period) {
+        mLatency.setSamplePeriod(period);
+    }
+#endif
+
+    // a miss inserts a default constructed value, so only available for default constructible copyable values.
+    // find() and emplace() cover everything else
+    V get(KeyParam key) requires DefaultContructible<V> && std::copy_constructible<V> {
+        return getOrInsert(key, hashOf(key));
+    }
+
+    template<typename Q>
+        requires IsHeterogeneousKey<Q> && std::constructible_from<K, const Q&>
+                 && DefaultContructible<V> && std::copy_constructible<V>
+    V get(const Q& key) {
+        return getOrInsert(key, hashOf(key));
+    }
+
+    // pointer to the cached value, counts as a use. nullptr on a miss, nothing is inserted
+    V* find(KeyParam key) {
+        return findAndTouch(key, hashOf(key));
+    }
+
+    template<typename Q>
+        requires IsHeterogeneousKey<Q>
+    V* find(const Q& key) {
+        return findAndTouch(key, hashOf(key));
+    }
+
+    // find() with hash == hashOf(key) already known
+    template<typename Q>
+        requires IsLookupKey<Q>
+    V* findHashed(size_t hash, const Q& key) {
+        return findAndTouch(key, hash);
+    }
+
+    // side effect free lookup, neither frequency nor recency of the key change
+    const V* peek(KeyParam key) const {
+        auto it = lookup(key, hashOf(key));
+        return it == mKeyMetaByKey.end() ? nullptr : &it->second.val;
+    }
+
+    template<typename Q>
+        requires IsHeterogeneousKey<Q>
+    const V* peek(const Q& key) const {
+        auto it = lookup(key, hashOf(key));
+        return it == mKeyMetaByKey.end() ? nullptr : &it->second.val;
+    }
+
+    // how often key has been used, 0 if it is not cached. side effect free like peek()
+    template<typename Q>
+        requires IsLookupKey<Q>
+    int frequencyHashed(size_t hash, const Q& key) const {
+        auto it = lookup(key, hash);
+        return it == mKeyMetaByKey.end() ? 0 : it->second.freq;
+    }
+
+    // constructs the value in place from args if key is not cached yet, otherwise leaves the cached value alone
+    // and only counts a use. returns the cached value and whether it was inserted
+    template<typename KArg = K, typename... Args>
+        requires std::constructible_from<K, KArg&&> && std::constructible_from<V, Args&&...>
+    std::pair<V*, bool> emplace(KArg&& key, Args&&... args) {
+        if constexpr (!std::is_same_v<std::remove_cvref_t<KArg>, K>) {
+            return emplace(K(std::forward<KArg>(key)), std::forward<Args>(args)...);
+        } else {
+            LFU_LATENCY_SCOPE(mLatency, LatencyOp::Put);
+            size_t hash = hashOf(key);
+            auto it = lookup(key, hash);
+            if (it != mKeyMetaByKey.end()) {
+                touchEntry(*it);
+                return {&it->second.val, false};
+            }
+            Entry& entry = insert(hash, std::forward<KArg>(key), std::forward<Args>(args)...);
+            if (mDirtyWriter) {
+                setDirty(entry);
+            }
+            return {&entry.second.val, true};
+        }
+    }
+
+    // key and val are forwarded, so rvalues are moved into the cache and the value is built in place.
+    // returns true if key was inserted, false if an existing value was assigned
+    template<typename KArg = K, typename VArg = V>
+        requires std::constructible_from<K, KArg&&> && std::constructible_from<V, VArg&&>
+                 && std::is_assignable_v<V&, VArg&&>
+    bool insertOrAssign(KArg&& key, VArg&& val) {
+        if constexpr (!std::is_same_v<std::remove_cvref_t<KArg>, K>) {
+            // convert once instead of once for the lookup and again for the insert
+            return insertOrAssign(K(std::forward<KArg>(key)), std::forward<VArg>(val));
+        } else {
+            size_t hash = hashOf(key);
+            return insertOrAssignHashed(hash, std::forward<KArg>(key), std::forward<VArg>(val));
+        }
+    }
+
+    template<typename KArg = K, typename VArg = V>
+        requires std::constructible_from<K, KArg&&> && std::constructible_from<V, VArg&&>
+                 && std::is_assignable_v<V&, VArg&&>
+    void put(KArg&& key, VArg&& val) {
+        insertOrAssign(std::forward<KArg>(key), std::forward<VArg>(val));
+    }
+
+    // put() with hash == hashOf(key) already known, the key is not hashed again
+    template<typename KArg = K, typename VArg = V>
+        requires std::constructible_from<K, KArg&&> && std::constructible_from<V, VArg&&>
+                 && std::is_assignable_v<V&, VArg&&>
+    void putHashed(size_t hash, KArg&& key, VArg&& val) {
+        if constexpr (!std::is_same_v<std::remove_cvref_t<KArg>, K>) {
+            insertOrAssignHashed(hash, K(std::forward<KArg>(key)), std::forward<VArg>(val));
+        } else {
+            insertOrAssignHashed(hash, std::forward<KArg>(key), std::forward<VArg>(val));
+        }
+    }
+
+    // removes key, true if it was cached
+    bool erase(KeyParam key) {
+        return eraseEntry(key, hashOf(key));
+    }
+
+    template<typename Q>
+        requires IsHeterogeneousKey<Q>
+    bool erase(const Q& key) {
+        return eraseEntry(key, hashOf(key));
+    }
+
+    // erase() with hash == hashOf(key) already known
+    template<typename Q>
+        requires IsLookupKey<Q>
+    bool eraseHashed(size_t hash, const Q& key) {
+        return eraseEntry(key, hash);
+    }
+
+    // an empty listener turns notifications off, removals already queued stay queued
+    void setRemovalListener(RemovalListener listener, RemovalDelivery delivery = RemovalDelivery::Immediate) {
+        mRemovalListener = std::move(listener);
+        mRemovalDelivery = delivery;
+    }
+
+    // removals queued in Deferred mode, only swaps a vector so it is cheap to call under a lock
+    std::vector<Removal> takeRemovals() {
+        return std::exchange(mPendingRemovals, {});
+    }
+
+    // hands a batch from takeRemovals() to the listener, call it after releasing the lock
+    void deliverRemovals(std::vector<Removal>& batch) const {
+        if (!mRemovalListener) {
+            return;
+        }
+        for (Removal& removal : batch) {
+            mRemovalListener(std::move(removal.key), std::move(removal.val), removal.cause);
+        }
+    }
+
+    // takeRemovals() and deliverRemovals() for single threaded use, returns the number of removals delivered
+    size_t flushRemovals() {
+        std::vector<Removal> batch = takeRemovals();
+        deliverRemovals(batch);
+        return batch.size();
+    }
+
+    // write-back mode: put(), insertOrAssign() and emplace() mark entries dirty and writer(key, val) persists
+    // a dirty entry before eviction drops it. an empty writer turns the mode off and forgets what was dirty
+    void setWriteBack(DirtyWriter writer, WriteBackEviction eviction = WriteBackEviction::FlushVictim) {
+        mDirtyWriter = std::move(writer);
+        mWriteBackEviction = eviction;
+        if (!mDirtyWriter) {
+            mDirtyKeys.clear();
+            mDirtyIndex.clear();
+        }
+    }
+
+    size_t dirtyCount() const {
+        return mDirtyKeys.size();
+    }
+
+    bool isDirty(KeyParam key) const {
+        auto it = lookup(key, hashOf(key));
+        return it != mKeyMetaByKey.end() && isDirtyEntry(*it);
+    }
+
+    // for values changed in place through find(), false if key is not cached or write-back is off
+    bool markDirty(KeyParam key) {
+        auto it = lookup(key, hashOf(key));
+        if (it == mKeyMetaByKey.end() || !mDirtyWriter) {
+            return false;
+        }
+        setDirty(*it);
+        return true;
+    }
+
+    // passes up to max dirty entries to fn(key, val), longest dirty first, and marks them clean.
+    // writes to a key while it stays dirty are coalesced, only its latest value is passed on
+    template<typename Fn>
+    size_t flushDirty(size_t max, Fn&& fn) {
+        size_t flushed = 0;
+        while (flushed < max && !mDirtyKeys.empty()) {
+            Entry* entry = mDirtyKeys.front();
+            fn(std::as_const(entry->first.key), std::as_const(entry->second.val));
+            setClean(*entry);
+            ++flushed;
+        }
+        return flushed;
+    }
+
+    // flushDirty() through the writer given to setWriteBack()
+    size_t flushDirty(size_t max = std::numeric_limits<size_t>::max()) {
+        return flushDirty(max, mDirtyWriter);
+    }
+
+    void touch(KeyParam key) {
+        auto it = lookup(key, hashOf(key));
+        if (it != mKeyMetaByKey.end()) {
+            touchEntry(*it);
+        }
+    }
+
+    template<typename Q>
+        requires IsHeterogeneousKey<Q>
+    void touch(const Q& key) {
+        auto it = lookup(key, hashOf(key));
+        if (it != mKeyMetaByKey.end()) {
+            touchEntry(*it);
+        }
+    }
+
+    void evict() {
+        if (!mKeyMetaByKey.empty()) {
+            evictTo(mKeyMetaByKey.size() - 1);
+        }
+    }
+
+    // evicts in eviction order until at most target keys are left, returns how many were evicted. one pass
+    // up the frequency chain: each list is drained from its tail and the next one up takes over when it runs
+    // dry, so a victim costs the same whether it is the first of a batch or the last
+    size_t evictTo(size_t target) {
+        if (mKeyMetaByKey.size() <= target) {
+            return 0;
+        }
+        LFU_LATENCY_SCOPE(mLatency, LatencyOp::Evict);
+        size_t evicted = 0;
+        for (; mKeyMetaByKey.size() > target; ++evicted) {
+            evictFrom(*mLowest);
+        }
+        return evicted;
+    }
+
+    // a put() of a new key into a full cache evicts down to low keys rather than making room for just that
+    // one, so the next capacity - low inserts evict nothing. capacity is the high watermark, the default low
+    // watermark of capacity - 1 evicts one key per insert
+    void setLowWatermark(size_t low) {
+        if (low >= mCapacity) {
+            throw std::invalid_argument ("Low watermark must be below the capacity.");
+        }
+        mLowWatermark = low;
+    }
+
+    size_t lowWatermark() const {
+        return mLowWatermark;
+    }
+
+    // rebuilds the index with at least buckets buckets, e.g. for a lower load factor than the constructor's.
+    // entries keep their stored hash, so no key is hashed again
+    void rehash(size_t buckets) {
+        mKeyMetaByKey.rehash(buckets);
+    }
+
+private:
+    // fresh counters and empty containers charging them for a cache whose structures were moved away.
+    // the index is not reserved again, it grows on demand if the cache is used after the move
+    void resetAfterMove() {
+        Alloc alloc(mKeyMetaByKey.get_allocator().base());
+        IndexHash hash = mKeyMetaByKey.hash_function();
+        IndexEqual equal = mKeyMetaByKey.key_eq();
+        mCounters = std::make_unique<Counters>();
+        mKeysByFreq = decltype(mKeysByFreq)(0, std::hash<int>(), std::equal_to<int>(),
+                                            CountingAlloc<std::pair<const int, FreqList>>(&mCounters->freqs, alloc));
+        mKeyMetaByKey = decltype(mKeyMetaByKey)(0, hash, equal, CountingAlloc<Entry>(&mCounters->index, alloc));
+        mDirtyKeys = KeyList(CountingAlloc<Entry*>(&mCounters->dirty, alloc));
+        mDirtyIndex = decltype(mDirtyIndex)(0, std::hash<const Entry*>(), std::equal_to<const Entry*>(),
+                                            CountingAlloc<std::pair<const Entry* const, LstIter>>(&mCounters->dirty, alloc));
+        mLowest = nullptr;
+        mHighest = nullptr;
+        mRemovalListener = nullptr;
+        mPendingRemovals.clear();
+        mDirtyWriter = nullptr;
+    }
+
+    template<typename Q>
+    auto lookup(const Q& key, size_t hash) {
+        return mKeyMetaByKey.find(HashedRef<Q> {key, hash});
+    }
+
+    template<typename Q>
+    auto lookup(const Q& key, size_t hash) const {
+        return mKeyMetaByKey.find(HashedRef<Q> {key, hash});
+    }
+
+    // Q is K or a heterogeneous key type
+    template<typename Q>
+    V getOrInsert(const Q& key, size_t hash) {
+        LFU_LATENCY_SCOPE(mLatency, LatencyOp::Get);
+        auto it = lookup(key, hash);
+        if (it != mKeyMetaByKey.end()) {
+            // cache hit
+            touchEntry(*it);
+            return it->second.val;
+        }
+
+        // cache miss, we put a default constructed value in our cache
+        LFU_CACHE_PROBE1(get_miss, hash);
+        if constexpr (std::is_same_v<Q, K>) {
+            return insert(hash, key).second.val;
+        } else {
+            return insert(hash, K(key)).second.val;
+        }
+    }
+
+    template<typename Q>
+    V* findAndTouch(const Q& key, size_t hash) {
+        LFU_LATENCY_SCOPE(mLatency, LatencyOp::Get);
+        auto it = lookup(key, hash);
+        if (it == mKeyMetaByKey.end()) {
+            LFU_CACHE_PROBE1(get_miss, hash);
+            return nullptr;
+        }
+        touchEntry(*it);
+        return &it->second.val;
+    }
+
+    template<typename KArg, typename VArg>
+    bool insertOrAssignHashed(size_t hash, KArg&& key, VArg&& val) {
+        LFU_LATENCY_SCOPE(mLatency, LatencyOp::Put);
+        auto it = lookup(key, hash);
+        if (it != mKeyMetaByKey.end()) {
+            // cache contains val, update existing entry
+            touchEntry(*it);
+            if (mRemovalListener) {
+                V old = std::move(it->second.val);
+                it->second.val = std::forward<VArg>(val);
+                notifyRemoval(K(std::forward<KArg>(key)), std::move(old), RemovalCause::Replaced);
+            } else {
+                it->second.val = std::forward<VArg>(val);
+            }
+            if (mDirtyWriter) {
+                setDirty(*it);
+            }
+            return false;
+        }
+
+        Entry& entry = insert(hash, std::forward<KArg>(key), std::forward<VArg>(val));
+        if (mDirtyWriter) {
+            setDirty(entry);
+        }
+        return true;
+    }
+
+    template<typename Q>
+    bool eraseEntry(const Q& key, size_t hash) {
+        auto it = lookup(key, hash);
+        if (it == mKeyMetaByKey.end()) {
+            return false;
+        }
+
+        // an erased key is gone from the backing store's point of view too, a pending write is dropped
+        KeyMeta& meta = it->second;
+        setClean(*it);
+        FreqList& list = listOf(meta.freq);
+        list.keys.erase(meta.iter);
+        if (list.keys.empty()) {
+            unlink(list);
+        }
+        removeEntry(it, RemovalCause::Explicit);
+        return true;
+    }
+
+    // drops an index entry already unlinked from its list, the listener gets key and value moved out of the node
+    template<typename It>
+    void removeEntry(It it, RemovalCause cause) {
+        if (!mRemovalListener) {
+            mKeyMetaByKey.erase(it);
+            return;
+        }
+        auto node = mKeyMetaByKey.extract(it);
+        notifyRemoval(std::move(node.key().key), std::move(node.mapped().val), cause);
+    }
+
+    void notifyRemoval(K&& key, V&& val, RemovalCause cause) {
+        if (mRemovalDelivery == RemovalDelivery::Deferred) {
+            mPendingRemovals.push_back(Removal {std::move(key), std::move(val), cause});
+        } else {
+            mRemovalListener(std::move(key), std::move(val), cause);
+        }
+    }
+
+    void setDirty(Entry& entry) {
+        auto [it, inserted] = mDirtyIndex.try_emplace(&entry);
+        if (inserted) {
+            try {
+                it->second = mDirtyKeys.insert(mDirtyKeys.end(), &entry);
+            } catch (...) {
+                mDirtyIndex.erase(it);
+                throw;
+            }
+        }
+    }
+
+    void setClean(const Entry& entry) {
+        if (mDirtyIndex.empty()) {
+            return;
+        }
+        auto it = mDirtyIndex.find(&entry);
+        if (it != mDirtyIndex.end()) {
+            mDirtyKeys.erase(it->second);
+            mDirtyIndex.erase(it);
+        }
+    }
+
+    bool isDirtyEntry(const Entry& entry) const {
+        return !mDirtyIndex.empty() && mDirtyIndex.contains(&entry);
+    }
+
+    // first clean key among the CleanVictimScan least recently used of keys, the tail if all of them are dirty
+    LstIter cleanVictim(KeyList& keys) {
+        auto it = keys.end();
+        for (size_t scanned = 0; scanned < CleanVictimScan && it != keys.begin(); ++scanned) {
+            --it;
+            if (!isDirtyEntry(**it)) {
+                return it;
+            }
+        }
+        return std::prev(keys.end());
+    }
+
+    // unlinks and drops the eviction victim of list, the one at the minimum frequency
+    void evictFrom(FreqList& list) {
+        KeyList& keys = list.keys;
+        auto victimIt = std::prev(keys.end()); // key with least frequency and least recently used
+        if (mDirtyWriter && mWriteBackEviction == WriteBackEviction::CleanOnly) {
+            victimIt = cleanVictim(keys);
+        }
+        Entry* victim = *victimIt;
+        LFU_CACHE_PROBE2(evict, victim->first.hash, list.freq);
+
+        if (isDirtyEntry(*victim)) {
+            mDirtyWriter(victim->first.key, victim->second.val);
+            setClean(*victim);
+        }
+
+        // the stored hash leads straight to the victim's bucket, the key is only compared
+        keys.erase(victimIt);
+        if (keys.empty()) {
+            // the next lowest frequency is the next list up the chain
+            unlink(list);
+        }
+        removeEntry(lookup(victim->first.key, victim->first.hash), RemovalCause::Size);
+    }
+
+    // new entry at freq 1 with its value constructed in place from valArgs, evicts first when full
+    template<typename KArg, typename... VArgs>
+    Entry& insert(size_t hash, KArg&& key, VArgs&&... valArgs) {
+        if (mKeyMetaByKey.size() == mCapacity) {
+            evictTo(mLowWatermark);
+        }
+
+        FreqList& ones = listOf(1);
+        bool linked = !ones.keys.empty();
+        auto it = mKeyMetaByKey.try_emplace(IndexKey {std::forward<KArg>(key), hash}, std::in_place,
+                                            std::forward<VArgs>(valArgs)...).first;
+#ifdef LFU_CACHE_ENTRY_AGE
+        it->second.lastAccess = ++mClock;
+#endif
+        try {
+            ones.keys.push_front(&*it);
+        } catch (...) {
+            mKeyMetaByKey.erase(it);
+            throw;
+        }
+        if (!linked) {
+            link(ones, nullptr); // 1 is the lowest frequency there is
+        }
+        it->second.iter = ones.keys.begin();
+        LFU_CACHE_PROBE2(put_insert, hash, mKeyMetaByKey.size());
+        return *it;
+    }
+
+    void touchEntry(Entry& entry) {
+        LFU_LATENCY_SCOPE(mLatency, LatencyOp::Touch);
+        KeyMeta& meta = entry.second;
+        int oldFreq = meta.freq;
+        int newFreq = oldFreq + 1;
+
+        // move the list node to the head of the list at new freq, no allocation. the new list is usually
+        // the next one up the chain, otherwise it is empty and gets linked in right above the old one.
+        // references into mKeysByFreq survive the insert listOf(newFreq) may do, only iterators would not
+        FreqList& oldList = listOf(oldFreq);
+        FreqList& newList = oldList.higher != nullptr && oldList.higher->freq == newFreq ? *oldList.higher
+                                                                                          : listOf(newFreq);
+        if (newList.keys.empty()) {
+            link(newList, &oldList);
+        }
+        newList.keys.splice(newList.keys.begin(), oldList.keys, meta.iter);
+        if (oldList.keys.empty()) {
+            unlink(oldList);
+        }
+
+        meta.freq = newFreq;
+#ifdef LFU_CACHE_ENTRY_AGE
+        meta.lastAccess = ++mClock;
+#endif
+        LFU_CACHE_PROBE3(touch, entry.first.hash, oldFreq, newFreq);
+    }
+
+    // list of keys at freq, created on first use with an allocator charging the list counters
+    FreqList& listOf(int freq) {
+        auto it = mKeysByFreq.find(freq);
+        if (it == mKeysByFreq.end()) {
+            it = mKeysByFreq.try_emplace(freq, freq, CountingAlloc<Entry*>(&mCounters->lists, mKeysByFreq.get_allocator().base())).first;
+        }
+        return it->second;
+    }
+
+    // chains list, which just got its first key, in right above lower, or at the bottom for nullptr
+    void link(FreqList& list, FreqList* lower) {
+        list.lower = lower;
+        list.higher = lower != nullptr ? lower->higher : mLowest;
+        (lower != nullptr ? lower->higher : mLowest) = &list;
+        (list.higher != nullptr ? list.higher->lower : mHighest) = &list;
+    }
+
+    // takes list, which just lost its last key, out of the chain
+    void unlink(FreqList& list) {
+        (list.lower != nullptr ? list.lower->higher : mLowest) = list.higher;
+        (list.higher != nullptr ? list.higher->lower : mHighest) = list.lower;
+        list.lower = nullptr;
+        list.higher = nullptr;
+    }
+};
+
+#ifdef LFU_CACHE_EXTERN_TEMPLATES
+// compiled once in LFUCacheInstantiations.cpp, link lfu_cache::instantiations
+extern template class LFUCache<int, int>;
+extern template class LFUCache<uint64_t, uint64_t>;
+extern template class LFUCache<std::string, std::string>;
+#endif
@@ -0,0 +1,8 @@
+// the LFUCache types most users need, compiled once into lfu_cache_instantiations.
+// LFUCache.h declares them extern when LFU_CACHE_EXTERN_TEMPLATES is defined, keep both lists in sync
+
+#include "LFUCache.h"
+
+template class LFUCache<int, int>;
+template class LFUCache<uint64_t, uint64_t>;
+template class LFUCache<std::string, std::string>;
@@ -0,0 +1,26 @@
+#pragma once
+
+// static tracepoints for bpftrace/systemtap, provider name "lfu_cache".
+// compile with -DLFU_CACHE_USDT to emit them, each probe is a single nop until a tracer attaches.
+// probe arguments are still computed when enabled, so keep them cheap (key hashes, ints).
+//
+//   put_insert(key hash, size after insert)
+//   touch(key hash, old freq, new freq)
+//   evict(victim key hash, victim freq)
+//   get_miss(key hash)
+//
+//   bpftrace -e 'usdt:./app:lfu_cache:evict { @victim_freq = lhist(arg1, 0, 64, 1); }'
+
+#ifdef LFU_CACHE_USDT
+#if !__has_include(<sys/sdt.h>)
+#error "LFU_CACHE_USDT needs <sys/sdt.h> (systemtap-sdt-dev / systemtap-sdt-devel)"
+#endif
+#include <sys/sdt.h>
+#define LFU_CACHE_PROBE1(name, a) DTRACE_PROBE1(lfu_cache, name, a)
+#define LFU_CACHE_PROBE2(name, a, b) DTRACE_PROBE2(lfu_cache, name, a, b)
+#define LFU_CACHE_PROBE3(name, a, b, c) DTRACE_PROBE3(lfu_cache, name, a, b, c)
+#else
+#define LFU_CACHE_PROBE1(name, a) ((void)0)
+#define LFU_CACHE_PROBE2(name, a, b) ((void)0)
+#define LFU_CACHE_PROBE3(name, a, b, c) ((void)0)
+#endif
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// cheap timestamp source for latency sampling, rdtsc on x86 and steady_clock nanoseconds elsewhere
+struct TscClock {
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // ticks per nanosecond, calibrated once against steady_clock on first use
+    static double ticksPerNs() {
+        static const double ticks = calibrate();
+        return ticks;
+    }
+
+private:
+    static double calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+        auto wallStart = std::chrono::steady_clock::now();
+        uint64_t tscStart = now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        uint64_t tscEnd = now();
+        auto wallEnd = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(wallEnd - wallStart).count();
+        return ns > 0 ? (tscEnd - tscStart) / ns : 1.0;
+#else
+        return 1.0;
+#endif
+    }
+};
+
+// log-linear histogram in the spirit of HdrHistogram: values below 2^SubBits are counted exactly,
+// every power of two above is split into 2^SubBits linear buckets, so relative error stays under 2^-SubBits
+class LatencyHistogram {
+public:
+    static constexpr unsigned SubBits = 5;
+    static constexpr unsigned MaxBits = 44; // anything above 2^44 ticks (minutes) is clamped into the last bucket
+    static constexpr size_t SubCount = size_t{1} << SubBits;
+    static constexpr size_t BucketCount = (MaxBits - SubBits + 1) * SubCount;
+
+    void record(uint64_t value) {
+        mCounts[bucketOf(value)] += 1;
+        mTotal += 1;
+        mSum += value;
+        mMin = std::min(mMin, value);
+        mMax = std::max(mMax, value);
+    }
+
+    // histograms recorded on different threads can be combined afterwards, buckets line up exactly
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < BucketCount; ++i) {
+            mCounts[i] += other.mCounts[i];
+        }
+        mTotal += other.mTotal;
+        mSum += other.mSum;
+        mMin = std::min(mMin, other.mMin);
+        mMax = std::max(mMax, other.mMax);
+    }
+
+    void reset() {
+        *this = LatencyHistogram();
+    }
+
+    uint64_t count() const {
+        return mTotal;
+    }
+
+    uint64_t min() const {
+        return mTotal == 0 ? 0 : mMin;
+    }
+
+    uint64_t max() const {
+        return mMax;
+    }
+
+    double mean() const {
+        return mTotal == 0 ? 0.0 : static_cast<double>(mSum) / mTotal;
+    }
+
+    // value at quantile q in [0, 1], reported as the highest value of the bucket it falls into
+    uint64_t percentile(double q) const {
+        if (mTotal == 0) {
+            return 0;
+        }
+
+        q = std::clamp(q, 0.0, 1.0);
+        uint64_t rank = static_cast<uint64_t>(q * mTotal + 0.5);
+        rank = std::clamp<uint64_t>(rank, 1, mTotal);
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BucketCount; ++i) {
+            seen += mCounts[i];
+            if (seen >= rank) {
+                return std::clamp(highestOf(i), min(), mMax);
+            }
+        }
+        return mMax;
+    }
+
+    static size_t bucketOf(uint64_t value) {
+        if (value < SubCount) {
+            return value;
+        }
+
+        unsigned exp = std::bit_width(value) - 1;
+        if (exp >= MaxBits) {
+            return BucketCount - 1;
+        }
+
+        unsigned shift = exp - SubBits;
+        return (shift + 1) * SubCount + ((value >> shift) - SubCount);
+    }
+
+    static uint64_t highestOf(size_t bucket) {
+        size_t group = bucket / SubCount;
+        size_t sub = bucket % SubCount;
+        if (group == 0) {
+            return sub;
+        }
+
+        unsigned shift = group - 1;
+        uint64_t lowest = (SubCount + sub) << shift;
+        return lowest + (uint64_t{1} << shift) - 1;
+    }
+
+private:
+    std::array<uint64_t, BucketCount> mCounts {};
+    uint64_t mTotal = 0;
+    uint64_t mSum = 0;
+    uint64_t mMin = std::numeric_limits<uint64_t>::max();
+    uint64_t mMax = 0;
+};
+
+enum class LatencyOp { Get, Put, Touch, Evict, Count };
+
+inline const char* latencyOpName(LatencyOp op) {
+    switch (op) {
+        case LatencyOp::Get:   return "get";
+        case LatencyOp::Put:   return "put";
+        case LatencyOp::Touch: return "touch";
+        case LatencyOp::Evict: return "evict";
+        default:               return "unknown";
+    }
+}
+
+#ifndef LFU_CACHE_LATENCY_SAMPLE_PERIOD
+#define LFU_CACHE_LATENCY_SAMPLE_PERIOD 16 // time one in every N calls of each operation
+#endif
+
+// one histogram per cache operation, values are kept in raw ticks and converted to ns when dumped.
+// reading the tsc is not free (tens of ns under a hypervisor), so only every N-th call of an operation is timed
+class LatencyStats {
+public:
+    LatencyStats() {
+        setSamplePeriod(LFU_CACHE_LATENCY_SAMPLE_PERIOD);
+    }
+
+    // 1 times every call
+    void setSamplePeriod(uint32_t period) {
+        mSamplePeriod = std::max<uint32_t>(period, 1);
+        mCountdown.fill(mSamplePeriod);
+    }
+
+    uint32_t samplePeriod() const {
+        return mSamplePeriod;
+    }
+
+    // histogram to record into if this call of op is sampled, nullptr otherwise
+    LatencyHistogram* sample(LatencyOp op) {
+        auto i = static_cast<size_t>(op);
+        if (--mCountdown[i] != 0) {
+            return nullptr;
+        }
+        mCountdown[i] = mSamplePeriod;
+        return &mHistograms[i];
+    }
+
+    LatencyHistogram& operator[](LatencyOp op) {
+        return mHistograms[static_cast<size_t>(op)];
+    }
+
+    const LatencyHistogram& operator[](LatencyOp op) const {
+        return mHistograms[static_cast<size_t>(op)];
+    }
+
+    void merge(const LatencyStats& other) {
+        for (size_t i = 0; i < OpCount; ++i) {
+            mHistograms[i].merge(other.mHistograms[i]);
+        }
+    }
+
+    void reset() {
+        for (auto& histogram : mHistograms) {
+            histogram.reset();
+        }
+    }
+
+    void dumpText(std::ostream& os) const {
+        double tpn = TscClock::ticksPerNs();
+        os << std::left << std::setw(8) << "op" << std::right << std::setw(12) << "count";
+        for (const char* column : {"min(ns)", "p50(ns)", "p99(ns)", "p999(ns)", "max(ns)", "mean(ns)"}) {
+            os << std::setw(11) << column;
+        }
+        os << '\n';
+
+        for (size_t i = 0; i < OpCount; ++i) {
+            const auto& h = mHistograms[i];
+            os << std::left << std::setw(8) << latencyOpName(static_cast<LatencyOp>(i))
+               << std::right << std::setw(12) << h.count();
+            for (double ticks : {static_cast<double>(h.min()), static_cast<double>(h.percentile(0.5)),
+                                 static_cast<double>(h.percentile(0.99)), static_cast<double>(h.percentile(0.999)),
+                                 static_cast<double>(h.max()), h.mean()}) {
+                os << std::setw(11) << static_cast<uint64_t>(ticks / tpn);
+            }
+            os << '\n';
+        }
+    }
+
+    void dumpJson(std::ostream& os) const {
+        double tpn = TscClock::ticksPerNs();
+        os << '{';
+        for (size_t i = 0; i < OpCount; ++i) {
+            const auto& h = mHistograms[i];
+            os << (i == 0 ? "" : ",") << '"' << latencyOpName(static_cast<LatencyOp>(i)) << "\":{"
+               << "\"count\":" << h.count()
+               << ",\"min_ns\":" << h.min() / tpn
+               << ",\"p50_ns\":" << h.percentile(0.5) / tpn
+               << ",\"p99_ns\":" << h.percentile(0.99) / tpn
+               << ",\"p999_ns\":" << h.percentile(0.999) / tpn
+               << ",\"max_ns\":" << h.max() / tpn
+               << ",\"mean_ns\":" << h.mean() / tpn
+               << '}';
+        }
+        os << '}';
+    }
+
+private:
+    static constexpr size_t OpCount = static_cast<size_t>(LatencyOp::Count);
+    std::array<LatencyHistogram, OpCount> mHistograms;
+    std::array<uint32_t, OpCount> mCountdown;
+    uint32_t mSamplePeriod;
+};
+
+// records the ticks spent in a scope if the call is sampled, only used when LFU_CACHE_LATENCY is defined
+class ScopedLatency {
+public:
+    ScopedLatency(LatencyStats& stats, LatencyOp op)
+        : mHistogram(stats.sample(op)), mStart(mHistogram ? TscClock::now() : 0) {}
+    ~ScopedLatency() {
+        if (mHistogram) {
+            mHistogram->record(TscClock::now() - mStart);
+        }
+    }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    LatencyHistogram* mHistogram;
+    uint64_t mStart;
+};
+
+#ifdef LFU_CACHE_LATENCY
+#define LFU_LATENCY_CONCAT_IMPL(a, b) a##b
+#define LFU_LATENCY_CONCAT(a, b) LFU_LATENCY_CONCAT_IMPL(a, b)
+#define LFU_LATENCY_SCOPE(stats, op) ScopedLatency LFU_LATENCY_CONCAT(lfuLatency, __LINE__)((stats), (op))
+#else
+#define LFU_LATENCY_SCOPE(stats, op) ((void)0)
+#endif
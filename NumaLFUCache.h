@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "Arena.h"
+#include "LFUCache.h"
+
+// NUMA nodes and their cpus as sysfs lists them, fake nodes (numa=fake=N on the kernel command line) included.
+// without sysfs everything is node 0
+class NumaTopology {
+public:
+    static const NumaTopology& system() {
+        static const NumaTopology topology;
+        return topology;
+    }
+
+    size_t nodeCount() const {
+        return mCpusByNode.size();
+    }
+
+    const std::vector<int>& cpusOf(int node) const {
+        return mCpusByNode.at(node);
+    }
+
+    int nodeOfCpu(int cpu) const {
+        return cpu >= 0 && static_cast<size_t>(cpu) < mNodeByCpu.size() ? mNodeByCpu[cpu] : 0;
+    }
+
+    // node the calling thread works on: the one given to bindThread(), else the node of the cpu it runs on now
+    static int currentNode() {
+        if (tThreadNode >= 0) {
+            return tThreadNode;
+        }
+#if defined(__linux__)
+        return system().nodeOfCpu(sched_getcpu());
+#else
+        return 0;
+#endif
+    }
+
+    // pins the calling thread to the cpus of node and makes node its currentNode(). a node without known
+    // cpus (more nodes asked for than the box has) only sets currentNode()
+    static void bindThread(int node) {
+        tThreadNode = node;
+#if defined(__linux__)
+        const NumaTopology& topology = system();
+        if (static_cast<size_t>(node) >= topology.nodeCount()) {
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : topology.cpusOf(node)) {
+            CPU_SET(cpu, &set);
+        }
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+    }
+
+private:
+    NumaTopology() {
+#if defined(__linux__)
+        for (int node : parseList(readLine("/sys/devices/system/node/online"))) {
+            if (static_cast<size_t>(node) >= mCpusByNode.size()) {
+                mCpusByNode.resize(node + 1);
+            }
+            mCpusByNode[node] = parseList(readLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+            for (int cpu : mCpusByNode[node]) {
+                if (static_cast<size_t>(cpu) >= mNodeByCpu.size()) {
+                    mNodeByCpu.resize(cpu + 1, 0);
+                }
+                mNodeByCpu[cpu] = node;
+            }
+        }
+#endif
+        if (mCpusByNode.empty()) {
+            mCpusByNode.resize(1);
+        }
+    }
+
+    static std::string readLine(const std::string& path) {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    // "0-3,8,10-11"
+    static std::vector<int> parseList(const std::string& list) {
+        std::vector<int> values;
+        std::stringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            size_t dash = range.find('-');
+            try {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int i = first; i <= last; ++i) {
+                    values.push_back(i);
+                }
+            } catch (const std::exception&) {
+                // not a number, skip it
+            }
+        }
+        return values;
+    }
+
+    static inline thread_local int tThreadNode = -1;
+
+    std::vector<std::vector<int>> mCpusByNode;
+    std::vector<int> mNodeByCpu;
+};
+
+// sharded LFUCache with every shard's entries, index and list nodes allocated from an Arena bound to one
+// NUMA node, shardsPerNode shards per node. a key has one home shard picked by its hash, homeNodeOf() tells
+// callers which node to run work on a key on so that it stays local.
+//
+// with replicaCapacity set, every node also keeps a small LFUCache of copies of hot entries whose home is on
+// another node: a read looks in its own node's replicas first, and a hit on a remote home shard copies the
+// entry over once it has been used replicaMinFreq times. put() and erase() drop the copies on every node while
+// holding the home shard's lock, and copies are only made under that lock too, so a replica never holds a
+// value older than its home. values are handed out as const for the same reason.
+// memory the keys and values allocate themselves (long strings) comes from the default heap
+template<typename K, typename V, typename Hash = DefaultHash<K>, typename KeyEqual = DefaultKeyEqual<K>>
+class NumaLFUCache {
+public:
+    using Cache = LFUCache<K, V, Hash, KeyEqual, ArenaAllocator<std::pair<const K, V>>>;
+
+    struct Options {
+        size_t nodes = 0; // 0 takes the count from NumaTopology::system()
+        size_t shardsPerNode = 4;
+        size_t replicaCapacity = 0; // copies of remote hot entries per node, 0 turns replication off
+        int replicaMinFreq = 8;
+    };
+
+    explicit NumaLFUCache(size_t capacity, Options options = Options())
+        : mCapacity(capacity), mOptions(options) {
+        if (capacity <= 0) {
+            throw std::invalid_argument ("Capacity cannot be less than or equal to zero.");
+        }
+        mNodeCount = options.nodes != 0 ? options.nodes : NumaTopology::system().nodeCount();
+        if (capacity < mNodeCount) {
+            throw std::invalid_argument ("Capacity must be at least the number of NUMA nodes.");
+        }
+        // fewer shards per node when the capacity cannot fill them, the remainder of the split goes one key each
+        // to the first shards, so the shard capacities add up to exactly capacity
+        mShardsPerNode = std::min(std::max<size_t>(options.shardsPerNode, 1), capacity / mNodeCount);
+        size_t count = mNodeCount * mShardsPerNode;
+        for (size_t i = 0; i < count; ++i) {
+            size_t share = capacity / count + (i < capacity % count);
+            mShards.push_back(std::make_unique<Shard>(share, static_cast<int>(i / mShardsPerNode)));
+        }
+        if (options.replicaCapacity != 0) {
+            for (size_t node = 0; node < mNodeCount; ++node) {
+                mReplicas.push_back(std::make_unique<Shard>(options.replicaCapacity, static_cast<int>(node)));
+            }
+        }
+    }
+
+    size_t nodeCount() const {
+        return mNodeCount;
+    }
+
+    size_t shardCount() const {
+        return mShards.size();
+    }
+
+    size_t capacity() const {
+        return mCapacity;
+    }
+
+    // keys in their home shards, replicas not counted
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& shard : mShards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->cache.size();
+        }
+        return total;
+    }
+
+    size_t replicaSize(int node) const {
+        if (mReplicas.empty()) {
+            return 0;
+        }
+        Shard& replica = *mReplicas[node % mNodeCount];
+        std::lock_guard<std::mutex> lock(replica.mutex);
+        return replica.cache.size();
+    }
+
+    template<typename Q>
+    size_t hashOf(const Q& key) const {
+        return mShards[0]->cache.hashOf(key);
+    }
+
+    template<typename Q>
+    int homeNodeOf(const Q& key) const {
+        return static_cast<int>(shardIndexOf(hashOf(key)) / mShardsPerNode);
+    }
+
+    // calls fn(const V&) on a hit with the shard (or this node's replica) locked, counts as a use
+    template<typename Q, typename Fn>
+    bool find(const Q& key, Fn&& fn) {
+        size_t hash = hashOf(key);
+        size_t home = shardIndexOf(hash);
+        size_t node = NumaTopology::currentNode() % mNodeCount;
+        bool remote = home / mShardsPerNode != node;
+        if (remote && !mReplicas.empty()) {
+            Shard& replica = *mReplicas[node];
+            std::lock_guard<std::mutex> lock(replica.mutex);
+            if (const V* val = replica.cache.findHashed(hash, key)) {
+                fn(*val);
+                return true;
+            }
+        }
+
+        Shard& shard = *mShards[home];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const V* val = shard.cache.findHashed(hash, key);
+        if (val == nullptr) {
+            return false;
+        }
+        fn(*val);
+        if (remote && !mReplicas.empty() && shard.cache.frequencyHashed(hash, key) >= mOptions.replicaMinFreq) {
+            Shard& replica = *mReplicas[node];
+            std::lock_guard<std::mutex> replicaLock(replica.mutex);
+            replica.cache.putHashed(hash, K(key), *val);
+        }
+        return true;
+    }
+
+    // copy of the cached value, counts as a use
+    template<typename Q>
+    std::optional<V> get(const Q& key) {
+        std::optional<V> result;
+        find(key, [&](const V& val) { result.emplace(val); });
+        return result;
+    }
+
+    template<typename KArg = K, typename VArg = V>
+    void put(KArg&& key, VArg&& val) {
+        size_t hash = hashOf(key);
+        size_t home = shardIndexOf(hash);
+        Shard& shard = *mShards[home];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        dropReplicas(home, hash, key);
+        shard.cache.putHashed(hash, std::forward<KArg>(key), std::forward<VArg>(val));
+    }
+
+    template<typename Q>
+    bool erase(const Q& key) {
+        size_t hash = hashOf(key);
+        size_t home = shardIndexOf(hash);
+        Shard& shard = *mShards[home];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        dropReplicas(home, hash, key);
+        return shard.cache.eraseHashed(hash, key);
+    }
+
+private:
+    // the arena is declared first so that it outlives the cache allocating from it
+    struct alignas(64) Shard {
+        Shard(size_t capacity, int node)
+            : arena(Arena::Options {.node = node}),
+              cache(capacity, Hash(), KeyEqual(), ArenaAllocator<std::pair<const K, V>>(arena)) {}
+
+        mutable std::mutex mutex;
+        Arena arena;
+        Cache cache;
+    };
+
+    // same mix as ShardedLFUCache, the high bits pick the shard and the low ones the index bucket
+    size_t shardIndexOf(size_t hash) const {
+        return ((static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15ULL) >> 32) % mShards.size();
+    }
+
+    // the home node never holds a replica of its own keys
+    template<typename Q>
+    void dropReplicas(size_t home, size_t hash, const Q& key) {
+        for (size_t node = 0; node < mReplicas.size(); ++node) {
+            if (node != home / mShardsPerNode) {
+                std::lock_guard<std::mutex> lock(mReplicas[node]->mutex);
+                mReplicas[node]->cache.eraseHashed(hash, key);
+            }
+        }
+    }
+
+    size_t mCapacity;
+    Options mOptions;
+    size_t mNodeCount;
+    size_t mShardsPerNode;
+    std::vector<std::unique_ptr<Shard>> mShards;
+    std::vector<std::unique_ptr<Shard>> mReplicas; // one per node, empty without replication
+};
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "LFUCache.h"
+#include "VictimSelect.h"
+
+// approximate LFU in struct of arrays layout: keys, values, key hashes, frequencies and recency stamps each
+// live in their own array indexed by slot, and the used slots are kept dense in [0, size) by moving the last
+// one into any hole. there are no frequency lists; eviction looks at a window of sampleSize consecutive slots
+// from a random start and drops the one with the lowest frequency, the least recently used among equals,
+// the way Redis samples for its approximate LFU. a window is sampleSize * (sizeof(Counter) + 4) bytes of
+// frequencies and stamps and never touches a key or value but the victim's, so a scan stays on a few cache
+// lines and is picked with the SIMD kernels of VictimSelect.h.
+//
+// frequencies are uint8_t or uint16_t counters saturating at their maximum, 8 bit ones fit twice as many
+// candidates per vector. stamps are a 32 bit access clock compared by age, which is exact as long as a slot
+// is used at least once every 2^32 accesses
+template<typename K, typename V, typename Hash = DefaultHash<K>, typename KeyEqual = DefaultKeyEqual<K>,
+         victim_select::PackedCounter Counter = uint16_t>
+class SampledLFUCache {
+public:
+    static constexpr uint32_t Nil = UINT32_MAX;
+
+    explicit SampledLFUCache(size_t capacity, uint32_t sampleSize = 16, const Hash& hash = Hash(),
+                             const KeyEqual& equal = KeyEqual())
+        : mHash(hash), mEqual(equal), mCapacity(static_cast<uint32_t>(capacity)),
+          mSampleSize(std::max<uint32_t>(sampleSize, 1)) {
+        if (capacity <= 0 || capacity >= Nil) {
+            throw std::invalid_argument ("Capacity must be between 1 and 2^32 - 2.");
+        }
+        mBucketMask = static_cast<uint32_t>(std::min<size_t>(std::bit_ceil(capacity), size_t(1) << 31)) - 1;
+        mBuckets.reset(new uint32_t[mBucketMask + 1]);
+        std::fill(mBuckets.get(), mBuckets.get() + mBucketMask + 1, Nil);
+        mNext.reset(new uint32_t[capacity]);
+        mHashes.reset(new uint32_t[capacity]);
+        mFreqs.reset(new Counter[capacity]);
+        mStamps.reset(new uint32_t[capacity]);
+        mKeys.reset(new Uninit<K>[capacity]);
+        mVals.reset(new Uninit<V>[capacity]);
+    }
+
+    ~SampledLFUCache() {
+        if (mKeys) {
+            for (uint32_t s = 0; s < mSize; ++s) {
+                std::destroy_at(&mKeys[s].value);
+                std::destroy_at(&mVals[s].value);
+            }
+        }
+    }
+
+    SampledLFUCache(SampledLFUCache&&) = default;
+    SampledLFUCache& operator=(SampledLFUCache&&) = delete;
+
+    size_t capacity() const {
+        return mCapacity;
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+    bool empty() const {
+        return mSize == 0;
+    }
+
+    uint32_t sampleSize() const {
+        return mSampleSize;
+    }
+
+    template<typename Q>
+    bool contains(const Q& key) const {
+        return findSlot(key, mHash(key)) != Nil;
+    }
+
+    // pointer to the cached value, counts as a use. nullptr on a miss
+    template<typename Q>
+    V* find(const Q& key) {
+        uint32_t s = findSlot(key, mHash(key));
+        if (s == Nil) {
+            return nullptr;
+        }
+        touch(s);
+        return &mVals[s].value;
+    }
+
+    // side effect free lookup, neither frequency nor recency of the key change
+    template<typename Q>
+    const V* peek(const Q& key) const {
+        uint32_t s = findSlot(key, mHash(key));
+        return s == Nil ? nullptr : &mVals[s].value;
+    }
+
+    // how often key has been used (saturating), 0 if it is not cached
+    template<typename Q>
+    int frequency(const Q& key) const {
+        uint32_t s = findSlot(key, mHash(key));
+        return s == Nil ? 0 : mFreqs[s];
+    }
+
+    // assigns (and counts a use) if key is cached, otherwise inserts, evicting first when full
+    template<typename KArg = K, typename VArg = V>
+    void put(KArg&& key, VArg&& val) {
+        size_t hash = mHash(key);
+        uint32_t s = findSlot(key, hash);
+        if (s != Nil) {
+            touch(s);
+            mVals[s].value = std::forward<VArg>(val);
+            return;
+        }
+        if (mSize == mCapacity) {
+            evict();
+        }
+
+        // the slot only counts as used once both its key and value are built
+        s = mSize;
+        std::construct_at(&mKeys[s].value, std::forward<KArg>(key));
+        try {
+            std::construct_at(&mVals[s].value, std::forward<VArg>(val));
+        } catch (...) {
+            std::destroy_at(&mKeys[s].value);
+            throw;
+        }
+        mSize += 1;
+        mHashes[s] = static_cast<uint32_t>(hash);
+        mFreqs[s] = 1;
+        mStamps[s] = ++mClock;
+        uint32_t& bucket = mBuckets[hash & mBucketMask];
+        mNext[s] = bucket;
+        bucket = s;
+    }
+
+    template<typename Q>
+    bool erase(const Q& key) {
+        uint32_t s = findSlot(key, mHash(key));
+        if (s == Nil) {
+            return false;
+        }
+        remove(s);
+        return true;
+    }
+
+    // drops the lowest frequency, least recently used slot of a window of sampleSize slots. the window may
+    // start at any slot and wraps around past the last one, so every slot is sampled equally often
+    void evict() {
+        if (mSize == 0) {
+            return;
+        }
+        uint32_t window = std::min(mSampleSize, mSize);
+        uint32_t start = static_cast<uint32_t>(nextRandom() % mSize);
+        uint32_t head = std::min(window, mSize - start);
+        uint32_t victim = start + victim_select::select(mFreqs.get() + start, mStamps.get() + start, head, mClock);
+        if (head < window) {
+            uint32_t wrapped = victim_select::select(mFreqs.get(), mStamps.get(), window - head, mClock);
+            if (colder(wrapped, victim)) {
+                victim = wrapped;
+            }
+        }
+        remove(victim);
+    }
+
+private:
+    // storage for a value constructed and destroyed by hand, so unused slots hold no object
+    template<typename T>
+    union Uninit {
+        Uninit() {}
+        ~Uninit() {}
+
+        T value;
+    };
+
+    template<typename Q>
+    uint32_t findSlot(const Q& key, size_t hash) const {
+        for (uint32_t s = mBuckets[hash & mBucketMask]; s != Nil; s = mNext[s]) {
+            if (mHashes[s] == static_cast<uint32_t>(hash) && mEqual(mKeys[s].value, key)) {
+                return s;
+            }
+        }
+        return Nil;
+    }
+
+    void touch(uint32_t s) {
+        mFreqs[s] += mFreqs[s] != std::numeric_limits<Counter>::max();
+        mStamps[s] = ++mClock;
+    }
+
+    // whether a goes before b in eviction order: lower frequency, or older among equals
+    bool colder(uint32_t a, uint32_t b) const {
+        if (mFreqs[a] != mFreqs[b]) {
+            return mFreqs[a] < mFreqs[b];
+        }
+        return static_cast<uint32_t>(mClock - mStamps[a]) > static_cast<uint32_t>(mClock - mStamps[b]);
+    }
+
+    // the link in s's bucket chain that points at s
+    uint32_t& linkTo(uint32_t s) {
+        uint32_t* link = &mBuckets[mHashes[s] & mBucketMask];
+        while (*link != s) {
+            link = &mNext[*link];
+        }
+        return *link;
+    }
+
+    // frees s and moves the last slot into it, so the used slots stay [0, size)
+    void remove(uint32_t s) {
+        linkTo(s) = mNext[s];
+        uint32_t last = mSize - 1;
+        if (s != last) {
+            linkTo(last) = s;
+            mNext[s] = mNext[last];
+            mHashes[s] = mHashes[last];
+            mFreqs[s] = mFreqs[last];
+            mStamps[s] = mStamps[last];
+            mKeys[s].value = std::move(mKeys[last].value);
+            mVals[s].value = std::move(mVals[last].value);
+        }
+        std::destroy_at(&mKeys[last].value);
+        std::destroy_at(&mVals[last].value);
+        mSize -= 1;
+    }
+
+    // xorshift64, only picks where windows start
+    uint64_t nextRandom() {
+        mRandom ^= mRandom << 13;
+        mRandom ^= mRandom >> 7;
+        mRandom ^= mRandom << 17;
+        return mRandom;
+    }
+
+    [[no_unique_address]] Hash mHash;
+    [[no_unique_address]] KeyEqual mEqual;
+    uint32_t mCapacity;
+    uint32_t mSampleSize;
+    uint32_t mSize = 0;
+    uint32_t mClock = 0;
+    uint32_t mBucketMask;
+    uint64_t mRandom = 0x9e3779b97f4a7c15ULL;
+    std::unique_ptr<uint32_t[]> mBuckets;
+    std::unique_ptr<uint32_t[]> mNext;   // next slot in the same bucket
+    std::unique_ptr<uint32_t[]> mHashes; // low bits of each slot's key hash
+    std::unique_ptr<Counter[]> mFreqs;
+    std::unique_ptr<uint32_t[]> mStamps; // mClock at the slot's last use
+    std::unique_ptr<Uninit<K>[]> mKeys;
+    std::unique_ptr<Uninit<V>[]> mVals;
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "LFUCache.h"
+
+// LFUCache split into independently locked shards so threads working on different keys rarely wait for each
+// other. the key is hashed once, the hash picks the shard and is handed to the shard's *Hashed calls.
+// every shard runs LFU on its own share of the capacity, so eviction is LFU per shard rather than global
+template<typename K, typename V, typename Hash = DefaultHash<K>, typename KeyEqual = DefaultKeyEqual<K>>
+class ShardedLFUCache {
+public:
+    using Cache = LFUCache<K, V, Hash, KeyEqual>;
+
+    // shards is rounded up to a power of two, and down to at most capacity so no shard is empty. capacity is
+    // split between them with the remainder spread one key each over the first shards, so the shard
+    // capacities add up to exactly capacity
+    ShardedLFUCache(size_t capacity, size_t shards = std::max(1u, std::thread::hardware_concurrency()))
+        : mCapacity(capacity) {
+        if (capacity <= 0) {
+            throw std::invalid_argument ("Capacity cannot be less than or equal to zero.");
+        }
+        size_t count = std::min(std::bit_ceil(std::max<size_t>(shards, 1)), std::bit_floor(capacity));
+        mShards.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            mShards.push_back(std::make_unique<Shard>(capacity / count + (i < capacity % count)));
+        }
+        mMask = count - 1;
+    }
+
+    size_t shardCount() const {
+        return mShards.size();
+    }
+
+    size_t capacity() const {
+        return mCapacity;
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& shard : mShards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->cache.size();
+        }
+        return total;
+    }
+
+    template<typename Q>
+    size_t hashOf(const Q& key) const {
+        return mShards[0]->cache.hashOf(key);
+    }
+
+    // calls fn(V&) with the shard locked on a hit, which counts as a use. lets callers read the value
+    // (e.g. straight into a reply buffer) without copying it out first
+    template<typename Q, typename Fn>
+    bool find(const Q& key, Fn&& fn) {
+        size_t hash = hashOf(key);
+        Shard& shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        V* val = shard.cache.findHashed(hash, key);
+        if (val == nullptr) {
+            return false;
+        }
+        fn(*val);
+        return true;
+    }
+
+    // find() for many keys at once, e.g. a pipeline of gets. the keys are grouped by shard and every shard is
+    // locked once for all of its keys. fn(i, V&) is called for each hit, i being the key's position in keys
+    template<typename Q, typename Fn>
+    void findMany(std::span<const Q> keys, Fn&& fn) {
+        struct Probe {
+            size_t shard;
+            size_t hash;
+            size_t index;
+        };
+        std::vector<Probe> probes;
+        probes.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            size_t hash = hashOf(keys[i]);
+            probes.push_back({shardIndexOf(hash), hash, i});
+        }
+        std::sort(probes.begin(), probes.end(), [](const Probe& a, const Probe& b) {
+            return a.shard != b.shard ? a.shard < b.shard : a.index < b.index;
+        });
+
+        for (size_t begin = 0; begin < probes.size();) {
+            Shard& shard = *mShards[probes[begin].shard];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            size_t end = begin;
+            for (; end < probes.size() && probes[end].shard == probes[begin].shard; ++end) {
+                if (V* val = shard.cache.findHashed(probes[end].hash, keys[probes[end].index])) {
+                    fn(probes[end].index, *val);
+                }
+            }
+            begin = end;
+        }
+    }
+
+    // copy of the cached value, counts as a use
+    template<typename Q>
+    std::optional<V> get(const Q& key) {
+        std::optional<V> result;
+        find(key, [&](V& val) { result.emplace(val); });
+        return result;
+    }
+
+    template<typename KArg = K, typename VArg = V>
+    void put(KArg&& key, VArg&& val) {
+        size_t hash = hashOf(key);
+        Shard& shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.cache.putHashed(hash, std::forward<KArg>(key), std::forward<VArg>(val));
+    }
+
+    template<typename Q>
+    bool erase(const Q& key) {
+        size_t hash = hashOf(key);
+        Shard& shard = shardOf(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.cache.eraseHashed(hash, key);
+    }
+
+    // calls fn(Cache&) for every shard in turn with that shard locked, for setup and introspection
+    template<typename Fn>
+    void forEachShard(Fn&& fn) {
+        for (auto& shard : mShards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            fn(shard->cache);
+        }
+    }
+
+private:
+    // own cache line each, so locking one shard does not bounce the line of its neighbour
+    struct alignas(64) Shard {
+        explicit Shard(size_t capacity) : cache(capacity) {}
+
+        mutable std::mutex mutex;
+        Cache cache;
+    };
+
+    // the index buckets use the low bits of the hash, the shard is picked from the high bits of a
+    // multiplicative mix so that keys in one shard still spread over all of its buckets
+    size_t shardIndexOf(size_t hash) const {
+        return ((static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15ULL) >> 32) & mMask;
+    }
+
+    Shard& shardOf(size_t hash) {
+        return *mShards[shardIndexOf(hash)];
+    }
+
+    size_t mCapacity;
+    size_t mMask;
+    std::vector<std::unique_ptr<Shard>> mShards;
+};
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "IndexLinkedLFU.h"
+
+// LFU cache living entirely in a POSIX shared memory segment, so several processes on a host share one cache
+// instead of each caching the same hot keys. the segment is mapped at a different address in every process,
+// so entries, hash chains and frequency lists link to each other by index into fixed arrays, never by pointer
+// (see IndexLinkedLFU.h).
+//
+// keys and values are copied into the segment and must be trivially copyable, and every process has to use
+// the same Hash (std::hash of a string is only stable within one build).
+//
+// all operations take one process shared robust mutex. if a process dies holding it, the next one to lock it
+// cannot know how far the dead process got, so it empties the cache and carries on
+template<typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+    requires std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>
+class SharedLFUCache {
+public:
+    // creates the segment name (e.g. "/my_cache") sized for capacity, or attaches to it if another process
+    // already has. attaching checks capacity and key / value sizes against what the creator used
+    SharedLFUCache(const std::string& name, size_t capacity) {
+        if (capacity <= 0 || capacity >= Nil) {
+            throw std::invalid_argument ("Capacity must be between 1 and 2^32 - 2.");
+        }
+        Layout layout(capacity);
+        mSize = layout.total;
+
+        bool created = true;
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            created = false;
+            fd = shm_open(name.c_str(), O_RDWR, 0600);
+        }
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+        }
+
+        try {
+            if (created) {
+                if (ftruncate(fd, mSize) != 0) {
+                    throw std::system_error(errno, std::generic_category(), "ftruncate " + name);
+                }
+            } else {
+                waitForSize(fd, name);
+            }
+            void* base = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category(), "mmap " + name);
+            }
+            mBase = static_cast<char*>(base);
+        } catch (...) {
+            close(fd);
+            if (created) {
+                shm_unlink(name.c_str());
+            }
+            throw;
+        }
+        close(fd);
+
+        mHeader = reinterpret_cast<Header*>(mBase);
+        mLists = Lists(&mHeader->state, reinterpret_cast<uint32_t*>(mBase + layout.buckets),
+                       reinterpret_cast<index_linked::Slot*>(mBase + layout.slots),
+                       reinterpret_cast<index_linked::FreqNode*>(mBase + layout.nodes));
+        mItems = reinterpret_cast<Item*>(mBase + layout.items);
+
+        if (created) {
+            initialize(capacity, layout.bucketCount);
+        } else {
+            try {
+                waitUntilReady(name, capacity);
+            } catch (...) {
+                // the destructor never runs for a constructor that throws
+                munmap(mBase, mSize);
+                throw;
+            }
+        }
+    }
+
+    ~SharedLFUCache() {
+        if (mBase != nullptr) {
+            munmap(mBase, mSize);
+        }
+    }
+
+    SharedLFUCache(SharedLFUCache&& other) noexcept
+        : mBase(std::exchange(other.mBase, nullptr)), mSize(other.mSize), mHeader(other.mHeader),
+          mLists(other.mLists), mItems(other.mItems) {}
+
+    SharedLFUCache& operator=(SharedLFUCache&& other) noexcept {
+        std::swap(mBase, other.mBase);
+        std::swap(mSize, other.mSize);
+        std::swap(mHeader, other.mHeader);
+        std::swap(mLists, other.mLists);
+        std::swap(mItems, other.mItems);
+        return *this;
+    }
+
+    // removes the segment name, processes that have it mapped keep using it until they unmap it
+    static void remove(const std::string& name) {
+        shm_unlink(name.c_str());
+    }
+
+    size_t capacity() const {
+        return mHeader->state.capacity;
+    }
+
+    size_t size() {
+        Lock lock(*this);
+        return mLists.size();
+    }
+
+    bool empty() {
+        return size() == 0;
+    }
+
+    bool contains(const K& key) {
+        Lock lock(*this);
+        return findSlot(key, Hash()(key)) != Nil;
+    }
+
+    // copy of the cached value, counts as a use
+    std::optional<V> get(const K& key) {
+        Lock lock(*this);
+        uint32_t s = findSlot(key, Hash()(key));
+        if (s == Nil) {
+            return std::nullopt;
+        }
+        mLists.touch(s);
+        return mItems[s].val;
+    }
+
+    void put(const K& key, const V& val) {
+        size_t hash = Hash()(key);
+        Lock lock(*this);
+        uint32_t s = findSlot(key, hash);
+        if (s != Nil) {
+            mLists.touch(s);
+            mItems[s].val = val;
+            return;
+        }
+        if (mLists.full()) {
+            mLists.remove(mLists.victim());
+        }
+        s = mLists.insert(hash);
+        mItems[s].key = key;
+        mItems[s].val = val;
+    }
+
+    bool erase(const K& key) {
+        Lock lock(*this);
+        uint32_t s = findSlot(key, Hash()(key));
+        if (s == Nil) {
+            return false;
+        }
+        mLists.remove(s);
+        return true;
+    }
+
+    void evict() {
+        Lock lock(*this);
+        if (uint32_t victim = mLists.victim(); victim != Nil) {
+            mLists.remove(victim);
+        }
+    }
+
+private:
+    using Lists = index_linked::Lists;
+    static constexpr uint32_t Nil = index_linked::Nil;
+    static constexpr uint64_t Magic = 0x4c46555348415245ULL; // "LFUSHARE"
+
+    struct Header {
+        uint64_t magic;
+        uint32_t keySize;
+        uint32_t valSize;
+        std::atomic<uint32_t> ready; // set by the creator once everything below is initialized
+        pthread_mutex_t mutex;
+        index_linked::State state;
+    };
+
+    struct Item {
+        K key;
+        V val;
+    };
+
+    // byte offsets of the arrays behind the header, the same in every process for the same capacity
+    struct Layout {
+        explicit Layout(size_t capacity) : bucketCount(Lists::bucketCountFor(capacity)) {
+            buckets = align(sizeof(Header), alignof(uint32_t));
+            slots = align(buckets + bucketCount * sizeof(uint32_t), alignof(index_linked::Slot));
+            nodes = align(slots + capacity * sizeof(index_linked::Slot), alignof(index_linked::FreqNode));
+            items = align(nodes + capacity * sizeof(index_linked::FreqNode), alignof(Item));
+            total = items + capacity * sizeof(Item);
+        }
+
+        static size_t align(size_t offset, size_t alignment) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        size_t bucketCount;
+        size_t buckets;
+        size_t slots;
+        size_t nodes;
+        size_t items;
+        size_t total;
+    };
+
+    // holds the process shared mutex, recovering it when its last owner died while holding it
+    class Lock {
+    public:
+        explicit Lock(SharedLFUCache& cache) : mMutex(&cache.mHeader->mutex) {
+            int rc = pthread_mutex_lock(mMutex);
+            if (rc == EOWNERDEAD) {
+                cache.mLists.reset();
+                pthread_mutex_consistent(mMutex);
+            } else if (rc != 0) {
+                throw std::system_error(rc, std::generic_category(), "pthread_mutex_lock");
+            }
+        }
+
+        ~Lock() {
+            pthread_mutex_unlock(mMutex);
+        }
+
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+
+    private:
+        pthread_mutex_t* mMutex;
+    };
+
+    void waitForSize(int fd, const std::string& name) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        struct stat st {};
+        while (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) < mSize) {
+            if (st.st_size != 0 || std::chrono::steady_clock::now() > deadline) {
+                throw std::invalid_argument("Shared cache " + name + " exists with a different capacity.");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void initialize(size_t capacity, size_t bucketCount) {
+        Header* header = new (mBase) Header {};
+        header->magic = Magic;
+        header->keySize = sizeof(K);
+        header->valSize = sizeof(V);
+        header->state.capacity = static_cast<uint32_t>(capacity);
+        header->state.bucketCount = static_cast<uint32_t>(bucketCount);
+
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+
+        mLists.reset();
+        header->ready.store(1, std::memory_order_release);
+    }
+
+    void waitUntilReady(const std::string& name, size_t capacity) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (mHeader->ready.load(std::memory_order_acquire) == 0) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                throw std::runtime_error("Shared cache " + name + " was never initialized.");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (mHeader->magic != Magic || mHeader->keySize != sizeof(K) || mHeader->valSize != sizeof(V)
+            || mHeader->state.capacity != capacity) {
+            throw std::invalid_argument("Shared cache " + name + " was created with a different layout.");
+        }
+    }
+
+    uint32_t findSlot(const K& key, size_t hash) const {
+        return mLists.find(hash, [&](uint32_t s) { return KeyEqual()(mItems[s].key, key); });
+    }
+
+    char* mBase = nullptr;
+    size_t mSize = 0;
+    Header* mHeader = nullptr;
+    Lists mLists {nullptr, nullptr, nullptr, nullptr};
+    Item* mItems = nullptr;
+};
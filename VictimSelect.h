@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LFU_CACHE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// victim selection over a window of sampled slots: the index of the lowest frequency, the oldest stamp among
+// equal frequencies (ages are clock - stamp, so clock wrapping around is fine) and the first index among
+// equal ages. that is a min reduction over packed 8 or 16 bit counters followed by a max over 32 bit ages,
+// which is done here with SSE4.1 or AVX2 when the cpu has them. every kernel returns exactly what scalar()
+// returns. select() picks the widest kernel the cpu supports the first time it runs
+namespace victim_select {
+
+template<typename Counter>
+concept PackedCounter = std::same_as<Counter, uint8_t> || std::same_as<Counter, uint16_t>;
+
+template<PackedCounter Counter>
+using Kernel = uint32_t (*)(const Counter* freqs, const uint32_t* stamps, uint32_t count, uint32_t clock);
+
+template<PackedCounter Counter>
+uint32_t scalar(const Counter* freqs, const uint32_t* stamps, uint32_t count, uint32_t clock) {
+    uint32_t victim = 0;
+    for (uint32_t i = 1; i < count; ++i) {
+        if (freqs[i] < freqs[victim] || (freqs[i] == freqs[victim] && clock - stamps[i] > clock - stamps[victim])) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+#ifdef LFU_CACHE_X86_KERNELS
+
+// the scalar tails the kernels share, for the slots past the last full vector
+template<PackedCounter Counter>
+Counter minFrom(const Counter* freqs, uint32_t begin, uint32_t count, Counter min) {
+    for (uint32_t i = begin; i < count; ++i) {
+        min = std::min(min, freqs[i]);
+    }
+    return min;
+}
+
+template<PackedCounter Counter>
+uint32_t maxAgeFrom(const Counter* freqs, const uint32_t* stamps, uint32_t begin, uint32_t count, uint32_t clock,
+                    Counter minFreq, uint32_t maxAge) {
+    for (uint32_t i = begin; i < count; ++i) {
+        if (freqs[i] == minFreq) {
+            maxAge = std::max(maxAge, clock - stamps[i]);
+        }
+    }
+    return maxAge;
+}
+
+template<PackedCounter Counter>
+uint32_t firstFrom(const Counter* freqs, const uint32_t* stamps, uint32_t begin, uint32_t count, uint32_t clock,
+                   Counter minFreq, uint32_t maxAge) {
+    for (uint32_t i = begin; i < count; ++i) {
+        if (freqs[i] == minFreq && clock - stamps[i] == maxAge) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// four counters widened to 32 bit lanes
+template<PackedCounter Counter>
+__attribute__((target("sse4.1"))) inline __m128i widen4(const Counter* freqs) {
+    if constexpr (sizeof(Counter) == 1) {
+        int32_t packed;
+        std::memcpy(&packed, freqs, sizeof(packed));
+        return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+    } else {
+        return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(freqs)));
+    }
+}
+
+// lowest counter of a vector, through phminposuw (8 lanes of 16 bits)
+template<PackedCounter Counter>
+__attribute__((target("sse4.1"))) inline Counter hmin(__m128i v) {
+    if constexpr (sizeof(Counter) == 1) {
+        v = _mm_min_epu8(v, _mm_srli_epi16(v, 8));
+        v = _mm_and_si128(v, _mm_set1_epi16(0xff));
+    }
+    return static_cast<Counter>(_mm_cvtsi128_si32(_mm_minpos_epu16(v)));
+}
+
+__attribute__((target("sse4.1"))) inline uint32_t hmax32(__m128i v) {
+    v = _mm_max_epu32(v, _mm_shuffle_epi32(v, 0x4e));
+    v = _mm_max_epu32(v, _mm_shuffle_epi32(v, 0xb1));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(v));
+}
+
+template<PackedCounter Counter>
+__attribute__((target("sse4.1"))) uint32_t sse41(const Counter* freqs, const uint32_t* stamps, uint32_t count,
+                                                 uint32_t clock) {
+    constexpr uint32_t Lanes = 16 / sizeof(Counter);
+    Counter minFreq = std::numeric_limits<Counter>::max();
+    uint32_t i = 0;
+    if (count >= Lanes) {
+        __m128i min = _mm_loadu_si128(reinterpret_cast<const __m128i*>(freqs));
+        for (i = Lanes; i + Lanes <= count; i += Lanes) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(freqs + i));
+            min = sizeof(Counter) == 1 ? _mm_min_epu8(min, v) : _mm_min_epu16(min, v);
+        }
+        minFreq = hmin<Counter>(min);
+    }
+    minFreq = minFrom(freqs, i, count, minFreq);
+
+    // lanes off the lowest frequency keep the running max, so no age needs to be reserved as "none"
+    __m128i minv = _mm_set1_epi32(minFreq);
+    __m128i clockv = _mm_set1_epi32(static_cast<int32_t>(clock));
+    __m128i best = _mm_setzero_si128();
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i age = _mm_sub_epi32(clockv, _mm_loadu_si128(reinterpret_cast<const __m128i*>(stamps + i)));
+        __m128i candidate = _mm_cmpeq_epi32(widen4(freqs + i), minv);
+        best = _mm_max_epu32(best, _mm_blendv_epi8(best, age, candidate));
+    }
+    uint32_t maxAge = maxAgeFrom(freqs, stamps, i, count, clock, minFreq, hmax32(best));
+
+    __m128i agev = _mm_set1_epi32(static_cast<int32_t>(maxAge));
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i age = _mm_sub_epi32(clockv, _mm_loadu_si128(reinterpret_cast<const __m128i*>(stamps + i)));
+        __m128i hit = _mm_and_si128(_mm_cmpeq_epi32(widen4(freqs + i), minv), _mm_cmpeq_epi32(age, agev));
+        if (int mask = _mm_movemask_ps(_mm_castsi128_ps(hit))) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return firstFrom(freqs, stamps, i, count, clock, minFreq, maxAge);
+}
+
+// eight counters widened to 32 bit lanes
+template<PackedCounter Counter>
+__attribute__((target("avx2"))) inline __m256i widen8(const Counter* freqs) {
+    if constexpr (sizeof(Counter) == 1) {
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(freqs)));
+    } else {
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(freqs)));
+    }
+}
+
+template<PackedCounter Counter>
+__attribute__((target("avx2"))) uint32_t avx2(const Counter* freqs, const uint32_t* stamps, uint32_t count,
+                                              uint32_t clock) {
+    constexpr uint32_t Lanes = 32 / sizeof(Counter);
+    Counter minFreq = std::numeric_limits<Counter>::max();
+    uint32_t i = 0;
+    if (count >= Lanes) {
+        __m256i min = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(freqs));
+        for (i = Lanes; i + Lanes <= count; i += Lanes) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(freqs + i));
+            min = sizeof(Counter) == 1 ? _mm256_min_epu8(min, v) : _mm256_min_epu16(min, v);
+        }
+        __m128i low = _mm256_castsi256_si128(min);
+        __m128i high = _mm256_extracti128_si256(min, 1);
+        minFreq = hmin<Counter>(sizeof(Counter) == 1 ? _mm_min_epu8(low, high) : _mm_min_epu16(low, high));
+    }
+    minFreq = minFrom(freqs, i, count, minFreq);
+
+    __m256i minv = _mm256_set1_epi32(minFreq);
+    __m256i clockv = _mm256_set1_epi32(static_cast<int32_t>(clock));
+    __m256i best = _mm256_setzero_si256();
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m256i age = _mm256_sub_epi32(clockv, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stamps + i)));
+        __m256i candidate = _mm256_cmpeq_epi32(widen8(freqs + i), minv);
+        best = _mm256_max_epu32(best, _mm256_blendv_epi8(best, age, candidate));
+    }
+    __m128i best128 = _mm_max_epu32(_mm256_castsi256_si128(best), _mm256_extracti128_si256(best, 1));
+    uint32_t maxAge = maxAgeFrom(freqs, stamps, i, count, clock, minFreq, hmax32(best128));
+
+    __m256i agev = _mm256_set1_epi32(static_cast<int32_t>(maxAge));
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m256i age = _mm256_sub_epi32(clockv, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(stamps + i)));
+        __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi32(widen8(freqs + i), minv), _mm256_cmpeq_epi32(age, agev));
+        if (int mask = _mm256_movemask_ps(_mm256_castsi256_ps(hit))) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return firstFrom(freqs, stamps, i, count, clock, minFreq, maxAge);
+}
+
+#endif
+
+// the widest kernel this cpu runs, scalar() off x86 or without SSE4.1
+template<PackedCounter Counter>
+Kernel<Counter> best() {
+#ifdef LFU_CACHE_X86_KERNELS
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2<Counter>;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return &sse41<Counter>;
+    }
+#endif
+    return &scalar<Counter>;
+}
+
+template<PackedCounter Counter>
+uint32_t select(const Counter* freqs, const uint32_t* stamps, uint32_t count, uint32_t clock) {
+    static const Kernel<Counter> kernel = best<Counter>();
+    return kernel(freqs, stamps, count, clock);
+}
+
+} // namespace victim_select
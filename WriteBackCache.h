@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "LFUCache.h"
+
+// appends every written entry as a "key value" line, a stand-in backing store for tests and tools.
+// copies share the stream so the sink can be handed around as a std::function
+template<typename K, typename V>
+class FileSink {
+public:
+    explicit FileSink(const std::string& path)
+        : mOut(std::make_shared<std::ofstream>(path, std::ios::app)) {
+        if (!*mOut) {
+            throw std::runtime_error("Cannot open " + path + " for writing.");
+        }
+    }
+
+    void operator()(const std::vector<std::pair<K, V>>& batch) {
+        for (const auto& [key, val] : batch) {
+            *mOut << key << ' ' << val << '\n';
+        }
+        mOut->flush();
+    }
+
+private:
+    std::shared_ptr<std::ofstream> mOut;
+};
+
+// LFUCache in write-back mode behind a mutex. put() only marks entries dirty, a background thread hands them
+// to the sink in batches, so a key written many times between two flushes reaches the store once.
+// dirty victims of eviction join the next batch, until then get() still finds them. a batch the sink throws
+// on is queued again and retried, and put() waits while maxPending victims are queued for a slow store
+template<typename K, typename V, typename Hash = DefaultHash<K>, typename KeyEqual = DefaultKeyEqual<K>>
+class WriteBackCache {
+public:
+    using Batch = std::vector<std::pair<K, V>>;
+    using Sink = std::function<void(const Batch&)>;
+    using ErrorHandler = std::function<void(std::exception_ptr)>;
+
+    struct Options {
+        size_t batchSize = 256; // most entries per sink call, the flusher wakes early once this many are dirty
+        std::chrono::milliseconds interval {100}; // longest an entry stays dirty while the store keeps up
+        WriteBackEviction eviction = WriteBackEviction::CleanOnly;
+        size_t maxPending = 4096; // victims queued for the store before put() blocks, at least batchSize
+        ErrorHandler onError; // gets what the sink threw, from the flusher thread. the batch is retried after interval
+    };
+
+    WriteBackCache(size_t capacity, Sink sink, Options options = Options())
+        : mCache(capacity), mSink(std::move(sink)), mOptions(std::move(options)) {
+        mOptions.batchSize = std::max<size_t>(mOptions.batchSize, 1);
+        mOptions.maxPending = std::max(mOptions.maxPending, mOptions.batchSize);
+        mCache.setWriteBack([this](const K& key, const V& val) {
+            mEvicted.insert_or_assign(key, val); // called under mMutex from evict()
+        }, mOptions.eviction);
+        mFlusher = std::thread([this] { run(); });
+    }
+
+    // stops the flusher and writes whatever is still dirty, what the sink still fails on then is lost
+    ~WriteBackCache() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mWake.notify_one();
+        mDrained.notify_all();
+        mFlusher.join();
+        try {
+            flush();
+        } catch (...) {
+            reportError(std::current_exception());
+        }
+    }
+
+    WriteBackCache(const WriteBackCache&) = delete;
+    WriteBackCache& operator=(const WriteBackCache&) = delete;
+
+    template<typename KArg = K, typename VArg = V>
+    void put(KArg&& key, VArg&& val) {
+        bool full;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mEvicted.size() >= mOptions.maxPending) {
+                // the store is behind, hand the victims over before making more
+                mWake.notify_one();
+                mDrained.wait(lock, [this] { return mStop || mEvicted.size() < mOptions.maxPending; });
+            }
+            mCache.put(std::forward<KArg>(key), std::forward<VArg>(val));
+            full = mCache.dirtyCount() + mEvicted.size() >= mOptions.batchSize;
+        }
+        if (full) {
+            mWake.notify_one();
+        }
+    }
+
+    std::optional<V> get(const K& key) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (V* val = mCache.find(key)) {
+            return *val;
+        }
+
+        // evicted but not in the store yet, mEvicted holds the newer value of the two
+        for (const Pending* pending : {&mEvicted, &mWriting}) {
+            auto it = pending->find(key);
+            if (it != pending->end()) {
+                return it->second;
+            }
+        }
+        return std::nullopt;
+    }
+
+    size_t dirtyCount() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mCache.dirtyCount() + mEvicted.size();
+    }
+
+    // sink calls that threw so far
+    size_t sinkFailures() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mSinkFailures;
+    }
+
+    // writes everything dirty at the time of the call before returning. rethrows what the sink throws,
+    // the batch it failed on stays queued
+    void flush() {
+        while (flushBatch() >= mOptions.batchSize) {
+        }
+    }
+
+private:
+    // latest value per key, a victim evicted again before it is written replaces the older value
+    using Pending = std::unordered_map<K, V, Hash, KeyEqual>;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        bool failing = false;
+        while (!mStop) {
+            // a failing store gets the whole interval before the next attempt, however much is dirty
+            mWake.wait_for(lock, mOptions.interval, [this, failing] {
+                return mStop || (!failing && mCache.dirtyCount() + mEvicted.size() >= mOptions.batchSize);
+            });
+            lock.unlock();
+            try {
+                flush();
+                failing = false;
+            } catch (...) {
+                failing = true;
+                reportError(std::current_exception());
+            }
+            lock.lock();
+        }
+    }
+
+    // collects one batch under the cache lock and writes it after releasing it, returns its size.
+    // batches are collected and written one at a time, so the store sees writes to a key in order
+    size_t flushBatch() {
+        std::lock_guard<std::mutex> flushLock(mFlushMutex);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mWriting = std::exchange(mEvicted, {});
+            if (mWriting.size() < mOptions.batchSize) {
+                mCache.flushDirty(mOptions.batchSize - mWriting.size(), [this](const K& key, const V& val) {
+                    mWriting.insert_or_assign(key, val);
+                });
+            }
+        }
+        mDrained.notify_all();
+
+        size_t written = mWriting.size();
+        if (!mWriting.empty()) {
+            // only flushBatch() changes mWriting, get() reading it meanwhile is fine
+            Batch batch(mWriting.begin(), mWriting.end());
+            try {
+                mSink(batch);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mMutex);
+                // back to the queue, except for keys evicted again since, whose values are newer
+                mEvicted.merge(mWriting);
+                mWriting.clear();
+                throw;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWriting.clear();
+        return written;
+    }
+
+    void reportError(std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mSinkFailures += 1;
+        }
+        if (mOptions.onError) {
+            mOptions.onError(error);
+        }
+    }
+
+    LFUCache<K, V, Hash, KeyEqual> mCache;
+    Sink mSink;
+    Options mOptions;
+    Pending mEvicted; // dirty victims waiting for the next batch
+    Pending mWriting; // batch the sink is writing right now, still visible to get()
+    size_t mSinkFailures = 0;
+
+    mutable std::mutex mMutex; // guards mCache, mEvicted, mWriting, mSinkFailures and mStop
+    std::mutex mFlushMutex; // one batch at a time from collection to sink
+    std::condition_variable mWake;
+    std::condition_variable mDrained; // mEvicted was handed to the sink, put() may go on
+    bool mStop = false;
+    std::thread mFlusher;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// key and value types shared by the benchmarks
+
+struct Pod16 {
+    uint64_t a;
+    uint64_t b;
+
+    bool operator==(const Pod16&) const = default;
+};
+
+template<>
+struct std::hash<Pod16> {
+    size_t operator()(const Pod16& pod) const noexcept {
+        return std::hash<uint64_t>()(pod.a * 0x9e3779b97f4a7c15ULL ^ pod.b);
+    }
+};
+
+template<typename T>
+T makeItem(uint64_t i) {
+    if constexpr (std::is_same_v<T, int>) {
+        return static_cast<int>(i);
+    } else if constexpr (std::is_same_v<T, Pod16>) {
+        return Pod16 {i, ~i};
+    } else {
+        // long enough to defeat the small string optimization, like real cache keys
+        // formatted in a fixed buffer, gcc's string overflow warnings misfire on the std::string operations
+        // under LTO
+        constexpr std::string_view prefix = "lfu:bench:item:";
+        char buf[prefix.size() + 20];
+        std::fill(std::begin(buf), std::end(buf), '_');
+        std::copy(prefix.begin(), prefix.end(), buf);
+        std::to_chars(buf + prefix.size(), std::end(buf), i);
+        return std::string(buf, 32);
+    }
+}
+
+template<typename T>
+std::vector<T> makeItems(uint64_t first, size_t count) {
+    std::vector<T> items;
+    items.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        items.push_back(makeItem<T>(first + i));
+    }
+    return items;
+}
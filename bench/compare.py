@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Compare two google benchmark JSON outputs and fail on regressions.
+
+    python3 bench/compare.py baseline.json current.json [--threshold 0.10] [--metric cpu_time]
+
+Benchmarks run with --benchmark_repetitions are compared on their median. Exit code is 1 when any
+benchmark present in both files got slower than the threshold, 0 otherwise.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path, metric):
+    with open(path) as f:
+        data = json.load(f)
+
+    plain = {}
+    medians = {}
+    for bench in data.get("benchmarks", []):
+        if bench.get("error_occurred"):
+            continue
+        if bench.get("run_type") == "aggregate":
+            if bench.get("aggregate_name") == "median":
+                medians[bench["run_name"]] = bench[metric]
+        else:
+            # repetitions of the same benchmark share a name, keep the fastest
+            name = bench.get("run_name", bench["name"])
+            plain[name] = min(plain.get(name, bench[metric]), bench[metric])
+
+    plain.update(medians)
+    return plain
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10, help="allowed slowdown, 0.10 is 10%%")
+    parser.add_argument("--metric", default="cpu_time", choices=["cpu_time", "real_time"])
+    args = parser.parse_args()
+
+    baseline = load(args.baseline, args.metric)
+    current = load(args.current, args.metric)
+
+    regressions = 0
+    width = max((len(name) for name in current), default=10)
+    print(f"{'benchmark':<{width}} {'baseline':>12} {'current':>12} {'change':>9}")
+    for name, now in current.items():
+        if name not in baseline:
+            print(f"{name:<{width}} {'-':>12} {now:>12.1f} {'new':>9}")
+            continue
+
+        before = baseline[name]
+        change = (now - before) / before if before > 0 else 0.0
+        flag = ""
+        if change > args.threshold:
+            regressions += 1
+            flag = "  REGRESSION"
+        print(f"{name:<{width}} {before:>12.1f} {now:>12.1f} {change:>+8.1%}{flag}")
+
+    for name in baseline:
+        if name not in current:
+            print(f"{name:<{width}} {baseline[name]:>12.1f} {'-':>12} {'missing':>9}")
+
+    if regressions:
+        print(f"\n{regressions} benchmark(s) slower than {args.threshold:.0%}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,191 @@
+// google benchmark suite for the LFUCache hot paths
+//
+//   g++ -std=c++20 -O2 bench/lfu_bench.cpp -lbenchmark -lpthread -o lfu_bench
+//   ./lfu_bench --benchmark_format=json --benchmark_out=current.json
+//   python3 bench/compare.py bench/baseline.json current.json
+//
+// capacities run from 1K up to LFU_BENCH_MAX_CAPACITY (env, default 1M, set 100000000 for the full sweep)
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../LFUCache.h"
+#include "../tools/Workloads.h"
+#include "BenchItems.h"
+
+// random positions into [0, bound), pre-generated so the loop only indexes
+static std::vector<uint32_t> makeIndices(size_t bound, size_t count = 1 << 16) {
+    SplitMix64 rng(42);
+    std::vector<uint32_t> indices(count);
+    for (auto& index : indices) {
+        index = static_cast<uint32_t>(rng.below(bound));
+    }
+    return indices;
+}
+
+template<typename K, typename V>
+void fill(LFUCache<K, V>& cache, const std::vector<K>& keys, const V& val) {
+    for (const K& key : keys) {
+        cache.put(key, val);
+    }
+}
+
+template<typename K, typename V>
+void BM_GetHit(benchmark::State& state) {
+    size_t capacity = state.range(0);
+    LFUCache<K, V> cache(capacity);
+    auto keys = makeItems<K>(0, capacity);
+    fill(cache, keys, makeItem<V>(0));
+    auto indices = makeIndices(capacity);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.get(keys[indices[i++ & (indices.size() - 1)]]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// a miss inserts a default constructed value, so this measures miss + insert + evict on a full cache
+template<typename K, typename V>
+void BM_GetMiss(benchmark::State& state) {
+    size_t capacity = state.range(0);
+    LFUCache<K, V> cache(capacity);
+    auto keys = makeItems<K>(0, capacity * 2);
+    for (size_t i = 0; i < capacity; ++i) {
+        cache.put(keys[i], makeItem<V>(i));
+    }
+
+    size_t i = capacity;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.get(keys[i]));
+        i = i + 1 == keys.size() ? 0 : i + 1; // cycling 2x capacity keys through the cache never hits
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template<typename K, typename V>
+void BM_PutInsert(benchmark::State& state) {
+    size_t capacity = state.range(0);
+    auto keys = makeItems<K>(0, capacity);
+    V val = makeItem<V>(1);
+    auto cache = std::make_unique<LFUCache<K, V>>(capacity);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        if (i == capacity) {
+            // start over on an empty cache once it is full, so no insert ever evicts
+            state.PauseTiming();
+            cache = std::make_unique<LFUCache<K, V>>(capacity);
+            i = 0;
+            state.ResumeTiming();
+        }
+        cache->put(keys[i++], val);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template<typename K, typename V>
+void BM_PutUpdate(benchmark::State& state) {
+    size_t capacity = state.range(0);
+    LFUCache<K, V> cache(capacity);
+    auto keys = makeItems<K>(0, capacity);
+    fill(cache, keys, makeItem<V>(0));
+    auto indices = makeIndices(capacity);
+    V val = makeItem<V>(2);
+
+    size_t i = 0;
+    for (auto _ : state) {
+        cache.put(keys[indices[i++ & (indices.size() - 1)]], val);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template<typename K, typename V>
+void BM_PutEvict(benchmark::State& state) {
+    size_t capacity = state.range(0);
+    LFUCache<K, V> cache(capacity);
+    auto keys = makeItems<K>(0, capacity * 2);
+    V val = makeItem<V>(3);
+    for (size_t i = 0; i < capacity; ++i) {
+        cache.put(keys[i], val);
+    }
+
+    size_t i = capacity;
+    for (auto _ : state) {
+        cache.put(keys[i], val);
+        i = i + 1 == keys.size() ? 0 : i + 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// zipf(0.99) keys over twice the capacity, state.range(1) percent of operations are gets, the rest puts
+template<typename K, typename V>
+void BM_Mixed(benchmark::State& state) {
+    size_t capacity = state.range(0);
+    int getPercent = static_cast<int>(state.range(1));
+    LFUCache<K, V> cache(capacity);
+    auto keys = makeItems<K>(0, capacity * 2);
+    auto stream = workloads::zipf(1 << 16, keys.size(), 0.99);
+    V val = makeItem<V>(4);
+
+    SplitMix64 rng(7);
+    std::vector<uint8_t> isGet(stream.size());
+    for (auto& op : isGet) {
+        op = rng.below(100) < static_cast<uint64_t>(getPercent);
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        size_t at = i++ & (stream.size() - 1);
+        const K& key = keys[stream[at]];
+        if (isGet[at]) {
+            benchmark::DoNotOptimize(cache.get(key));
+        } else {
+            cache.put(key, val);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template<typename K, typename V>
+void registerAll(const std::string& typeName, const std::vector<int64_t>& capacities) {
+    for (int64_t capacity : capacities) {
+        benchmark::RegisterBenchmark(("GetHit<" + typeName + ">").c_str(), BM_GetHit<K, V>)->Arg(capacity);
+        benchmark::RegisterBenchmark(("GetMiss<" + typeName + ">").c_str(), BM_GetMiss<K, V>)->Arg(capacity);
+        benchmark::RegisterBenchmark(("PutInsert<" + typeName + ">").c_str(), BM_PutInsert<K, V>)->Arg(capacity);
+        benchmark::RegisterBenchmark(("PutUpdate<" + typeName + ">").c_str(), BM_PutUpdate<K, V>)->Arg(capacity);
+        benchmark::RegisterBenchmark(("PutEvict<" + typeName + ">").c_str(), BM_PutEvict<K, V>)->Arg(capacity);
+        for (int getPercent : {50, 90, 99}) {
+            benchmark::RegisterBenchmark(("Mixed<" + typeName + ">").c_str(), BM_Mixed<K, V>)
+                ->Args({capacity, getPercent});
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int64_t maxCapacity = 1'000'000;
+    if (const char* env = std::getenv("LFU_BENCH_MAX_CAPACITY")) {
+        maxCapacity = std::strtoll(env, nullptr, 10);
+    }
+
+    std::vector<int64_t> capacities;
+    for (int64_t capacity = 1000; capacity <= maxCapacity && capacity <= 100'000'000; capacity *= 10) {
+        capacities.push_back(capacity);
+    }
+
+    registerAll<int, int>("int", capacities);
+    registerAll<Pod16, Pod16>("pod16", capacities);
+    registerAll<std::string, std::string>("string", capacities);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
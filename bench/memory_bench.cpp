@@ -0,0 +1,70 @@
+// heap bytes per cached entry for several key/value types and capacities, split by structure
+//
+//   g++ -std=c++20 -O2 bench/memory_bench.cpp -o memory_bench
+//   ./memory_bench [max capacity]
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "../CompactLFUCache.h"
+#include "../LFUCache.h"
+#include "BenchItems.h"
+
+template<typename K, typename V>
+void report(const std::string& typeName, size_t capacity) {
+    LFUCache<K, V> cache(capacity);
+    for (size_t i = 0; i < capacity; ++i) {
+        cache.put(makeItem<K>(i), makeItem<V>(i));
+    }
+    // promote a slice of the keys so there is more than one frequency list, as in a live cache
+    for (size_t i = 0; i < capacity; i += 8) {
+        cache.get(makeItem<K>(i));
+    }
+
+    MemoryUsage usage = cache.memoryUsage();
+    double entries = static_cast<double>(cache.size());
+    std::cout << std::left << std::setw(16) << typeName << std::right << std::setw(11) << capacity
+              << std::fixed << std::setprecision(1)
+              << std::setw(12) << usage.indexNodes.bytes / entries
+              << std::setw(12) << usage.indexBuckets.bytes / entries
+              << std::setw(12) << usage.listNodes.bytes / entries
+              << std::setw(12) << (usage.freqNodes.bytes + usage.freqBuckets.bytes) / entries
+              << std::setw(12) << usage.total() / entries
+              << std::setw(12) << (usage.indexNodes.blocks + usage.listNodes.blocks) / entries << "\n";
+}
+
+// CompactLFUCache allocates its arrays for the full capacity up front, so this is also its size when full
+template<typename K, typename V>
+void reportCompact(const std::string& typeName, size_t capacity) {
+    CompactLFUCache<K, V> cache(capacity);
+    std::cout << std::left << std::setw(16) << typeName << std::right << std::setw(11) << capacity
+              << std::fixed << std::setprecision(1) << std::setw(12)
+              << static_cast<double>(cache.memoryBytes()) / capacity << "\n";
+}
+
+int main(int argc, char** argv) {
+    size_t maxCapacity = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+
+    std::cout << "bytes per entry as requested from the allocator, strings are 32 chars (heap allocated)\n"
+              << "and their character buffers are not included\n\n";
+    std::cout << std::left << std::setw(16) << "K/V" << std::right << std::setw(11) << "capacity"
+              << std::setw(12) << "index" << std::setw(12) << "buckets" << std::setw(12) << "lists"
+              << std::setw(12) << "freq map" << std::setw(12) << "total" << std::setw(12) << "allocs" << "\n";
+
+    for (size_t capacity = 1000; capacity <= maxCapacity; capacity *= 10) {
+        report<int, int>("int/int", capacity);
+        report<Pod16, Pod16>("pod16/pod16", capacity);
+        report<std::string, std::string>("string/string", capacity);
+    }
+
+    std::cout << "\nCompactLFUCache\n" << std::left << std::setw(16) << "K/V" << std::right << std::setw(11)
+              << "capacity" << std::setw(12) << "total" << "\n";
+    for (size_t capacity = 1000; capacity <= maxCapacity; capacity *= 10) {
+        reportCompact<int, int>("int/int", capacity);
+        reportCompact<Pod16, Pod16>("pod16/pod16", capacity);
+        reportCompact<std::string, std::string>("string/string", capacity);
+    }
+    return 0;
+}
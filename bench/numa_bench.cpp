@@ -0,0 +1,146 @@
+// throughput of ShardedLFUCache against NumaLFUCache (with and without replicas) with threads spread evenly
+// over the NUMA nodes, every thread bound to its node and running zipf distributed gets and puts.
+// the nodes are those in sysfs, so a box booted with numa=fake=N works too (placement then has no effect
+// on latency, but routing and replication are exercised)
+//
+//   usage: numa_bench [-t threads per node] [-n ops per thread] [-k keys] [-c capacity] [-z skew]
+//                     [-r get ratio] [-R replica capacity] [-N nodes]
+
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../NumaLFUCache.h"
+#include "../ShardedLFUCache.h"
+#include "../tools/Workloads.h"
+
+struct Options {
+    size_t threadsPerNode = 2;
+    size_t ops = 2'000'000;
+    uint64_t keys = 1'000'000;
+    size_t capacity = 500'000;
+    double skew = 0.99;
+    double getRatio = 0.95;
+    size_t replicaCapacity = 10'000;
+    size_t nodes = 0;
+};
+
+static void usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [-t threads per node] [-n ops per thread] [-k keys] [-c capacity]"
+              << " [-z skew] [-r get ratio] [-R replica capacity] [-N nodes]\n";
+}
+
+// every thread replays its own zipf stream and picks get or put from a second random stream
+template<typename Cache>
+static void run(const std::string& name, Cache& cache, const Options& options, size_t nodes) {
+    for (uint64_t key = 0; key < options.capacity; ++key) {
+        cache.put(key, key);
+    }
+
+    size_t threads = nodes * options.threadsPerNode;
+    std::vector<std::vector<uint64_t>> streams;
+    for (size_t t = 0; t < threads; ++t) {
+        streams.push_back(workloads::zipf(options.ops, options.keys, options.skew, t + 1));
+    }
+    uint64_t getThreshold = static_cast<uint64_t>(options.getRatio * 1024);
+
+    std::atomic<size_t> ready {0};
+    std::atomic<bool> go {false};
+    std::atomic<uint64_t> hits {0};
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            NumaTopology::bindThread(static_cast<int>(t % nodes));
+            ready.fetch_add(1);
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            uint64_t local = 0;
+            SplitMix64 rng(t + 100);
+            for (uint64_t key : streams[t]) {
+                if ((rng.next() & 1023) < getThreshold) {
+                    local += cache.get(key).has_value();
+                } else {
+                    cache.put(key, key);
+                }
+            }
+            hits.fetch_add(local);
+        });
+    }
+    while (ready.load() != threads) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double totalOps = static_cast<double>(threads * options.ops);
+    std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << totalOps / seconds / 1e6 << " Mops/s" << std::setw(10)
+              << 100.0 * hits.load() / (totalOps * options.getRatio) << "% hits\n";
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (arg == "-t") {
+            options.threadsPerNode = std::stoull(argv[++i]);
+        } else if (arg == "-n") {
+            options.ops = std::stoull(argv[++i]);
+        } else if (arg == "-k") {
+            options.keys = std::stoull(argv[++i]);
+        } else if (arg == "-c") {
+            options.capacity = std::stoull(argv[++i]);
+        } else if (arg == "-z") {
+            options.skew = std::stod(argv[++i]);
+        } else if (arg == "-r") {
+            options.getRatio = std::stod(argv[++i]);
+        } else if (arg == "-R") {
+            options.replicaCapacity = std::stoull(argv[++i]);
+        } else if (arg == "-N") {
+            options.nodes = std::stoull(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.threadsPerNode == 0 || options.capacity == 0 || options.keys == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t nodes = options.nodes != 0 ? options.nodes : NumaTopology::system().nodeCount();
+    std::cout << nodes << " nodes, " << nodes * options.threadsPerNode << " threads, " << options.ops
+              << " ops each, capacity " << options.capacity << ", " << options.keys << " keys\n";
+
+    {
+        ShardedLFUCache<uint64_t, uint64_t> cache(options.capacity, nodes * 4);
+        run("sharded", cache, options, nodes);
+    }
+    {
+        NumaLFUCache<uint64_t, uint64_t>::Options numa;
+        numa.nodes = nodes;
+        NumaLFUCache<uint64_t, uint64_t> cache(options.capacity, numa);
+        run("numa", cache, options, nodes);
+    }
+    if (options.replicaCapacity != 0) {
+        NumaLFUCache<uint64_t, uint64_t>::Options numa;
+        numa.nodes = nodes;
+        numa.replicaCapacity = options.replicaCapacity;
+        NumaLFUCache<uint64_t, uint64_t> cache(options.capacity, numa);
+        run("numa + replicas", cache, options, nodes);
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+# builds the tools and benchmarks twice, once with LTO and once with LTO + PGO, then compares get/put
+# throughput of the two builds. each binary that is compared trains its own profile: workload_report on
+# the zipf workloads and, when Google Benchmark is there, lfu_bench on the get/put benchmarks
+#
+#   bench/pgo.sh [build dir, default ./build-pgo]
+
+set -euo pipefail
+
+src=$(cd "$(dirname "$0")/.." && pwd)
+out=$(mkdir -p "${1:-$src/build-pgo}" && cd "${1:-$src/build-pgo}" && pwd)
+jobs=$(nproc 2>/dev/null || echo 4)
+common=(-DCMAKE_BUILD_TYPE=Release -DLFU_CACHE_ENABLE_LTO=ON -DLFU_CACHE_BUILD_TESTS=OFF)
+profiles="$out/pgo/profiles"
+
+echo "== LTO build"
+cmake -S "$src" -B "$out/lto" "${common[@]}" > /dev/null
+cmake --build "$out/lto" -j "$jobs" > /dev/null
+
+echo "== instrumented build"
+rm -rf "$profiles"
+cmake -S "$src" -B "$out/pgo" "${common[@]}" -DLFU_CACHE_PGO=GENERATE -DLFU_CACHE_PGO_DIR="$profiles" > /dev/null
+cmake --build "$out/pgo" -j "$jobs" > /dev/null
+
+filter='^(GetHit|GetMiss|PutInsert|PutUpdate|PutEvict|Mixed)<(int|string)>/(1000|100000)(/90)?$'
+
+echo "== training on zipf"
+for skew in 0.8 0.99 1.2; do
+    "$out/pgo/workload_report" -w zipf -n 4000000 -k 1000000 -s "$skew" -c 1000,100000 -r 1 > /dev/null
+done
+if [[ -x "$out/pgo/lfu_bench" ]]; then
+    echo "== training on get/put benchmarks"
+    LFU_BENCH_MAX_CAPACITY=100000 "$out/pgo/lfu_bench" --benchmark_filter="$filter" > /dev/null
+fi
+if [[ "$(cmake -LA -N "$out/pgo" | grep CMAKE_CXX_COMPILER:)" == *clang* ]]; then
+    llvm-profdata merge -o "$profiles/default.profdata" "$profiles"/*.profraw
+fi
+
+echo "== PGO build"
+cmake -S "$src" -B "$out/pgo" -DLFU_CACHE_PGO=USE > /dev/null
+cmake --build "$out/pgo" -j "$jobs" > /dev/null
+
+echo
+echo "== zipf throughput, LTO"
+"$out/lto/workload_report" -w zipf -n 4000000 -k 1000000 -c 1000,100000 -r 5 | tail -n +3
+echo "== zipf throughput, LTO + PGO"
+"$out/pgo/workload_report" -w zipf -n 4000000 -k 1000000 -c 1000,100000 -r 5 | tail -n +3
+
+if [[ -x "$out/lto/lfu_bench" && -x "$out/pgo/lfu_bench" ]]; then
+    args=(--benchmark_filter="$filter" --benchmark_repetitions=5 --benchmark_format=json)
+    LFU_BENCH_MAX_CAPACITY=100000 "$out/lto/lfu_bench" "${args[@]}" --benchmark_out="$out/lto.json" > /dev/null
+    LFU_BENCH_MAX_CAPACITY=100000 "$out/pgo/lfu_bench" "${args[@]}" --benchmark_out="$out/pgo.json" > /dev/null
+
+    echo
+    echo "== get/put, LTO (baseline) vs LTO + PGO (current), negative change is a speedup"
+    python3 "$src/bench/compare.py" "$out/lto.json" "$out/pgo.json" --threshold 1.0
+fi
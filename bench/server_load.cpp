@@ -0,0 +1,352 @@
+// closed loop load generator for lfu_server over loopback: every connection sends pipelined batches of
+// get/set requests on zipf distributed keys and waits for all replies before sending the next batch
+//
+//   usage: server_load [-P memcached|resp] [-H 127.0.0.1] [-p port | -s unix socket path] [-c connections]
+//                      [-n requests] [-k keys] [-z skew] [-r get ratio] [-v value bytes] [-d pipeline depth] [-W]
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../LatencyHistogram.h"
+#include "../tools/Workloads.h"
+
+enum class Protocol { Memcached, Resp };
+
+struct Options {
+    Protocol protocol = Protocol::Memcached;
+    std::string host = "127.0.0.1";
+    uint16_t port = 0;
+    std::string unixPath;
+    size_t connections = 4;
+    size_t requests = 200000; // per connection
+    uint64_t keys = 100000;
+    double skew = 0.99;
+    double getRatio = 0.9;
+    size_t valueBytes = 100;
+    size_t depth = 16;
+    bool warm = true;
+};
+
+static int connectTo(const Options& options) {
+    if (!options.unixPath.empty()) {
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, options.unixPath.c_str(), sizeof(addr.sun_path) - 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            throw std::runtime_error("Cannot connect to " + options.unixPath + ": " + std::strerror(errno));
+        }
+        return fd;
+    }
+
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    std::string service = std::to_string(options.port);
+    if (int err = getaddrinfo(options.host.c_str(), service.c_str(), &hints, &result); err != 0) {
+        throw std::runtime_error("getaddrinfo: " + std::string(gai_strerror(err)));
+    }
+    int fd = -1;
+    for (addrinfo* ai = result; ai != nullptr && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot connect to " + options.host + ":" + service);
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static void sendAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("send: ") + std::strerror(errno));
+        }
+        data.remove_prefix(n);
+    }
+}
+
+// length of the first complete memcached reply in buf, 0 if it is not complete yet.
+// hit is set for a get that found its key
+static size_t parseMemcachedReply(std::string_view buf, bool& hit) {
+    size_t pos = 0;
+    hit = false;
+    while (true) {
+        size_t eol = buf.find("\r\n", pos);
+        if (eol == std::string_view::npos) {
+            return 0;
+        }
+        std::string_view line = buf.substr(pos, eol - pos);
+        pos = eol + 2;
+        if (!line.starts_with("VALUE ")) {
+            return pos; // END, STORED or an error, all end the reply
+        }
+
+        // VALUE <key> <flags> <bytes> [<cas>]
+        size_t bytesStart = line.find(' ', line.find(' ', 6) + 1) + 1;
+        size_t bytes = 0;
+        std::from_chars(line.data() + bytesStart, line.data() + line.size(), bytes);
+        if (buf.size() < pos + bytes + 2) {
+            return 0;
+        }
+        pos += bytes + 2;
+        hit = true;
+    }
+}
+
+// same for a RESP reply to GET or SET: a simple string, an error, or a bulk string that is $-1 on a miss
+static size_t parseRespReply(std::string_view buf, bool& hit) {
+    hit = false;
+    size_t eol = buf.find("\r\n");
+    if (eol == std::string_view::npos) {
+        return 0;
+    }
+    if (buf[0] != '$' || buf.substr(0, eol) == "$-1") {
+        return eol + 2;
+    }
+
+    size_t bytes = 0;
+    std::from_chars(buf.data() + 1, buf.data() + eol, bytes);
+    if (buf.size() < eol + 2 + bytes + 2) {
+        return 0;
+    }
+    hit = true;
+    return eol + 2 + bytes + 2;
+}
+
+static size_t parseReply(Protocol protocol, std::string_view buf, bool& hit) {
+    return protocol == Protocol::Resp ? parseRespReply(buf, hit) : parseMemcachedReply(buf, hit);
+}
+
+struct ConnectionResult {
+    uint64_t gets = 0;
+    uint64_t hits = 0;
+    uint64_t requests = 0;
+    LatencyHistogram batchNs;
+};
+
+// sends batch and reads until count replies are in
+static void roundTrip(Protocol protocol, int fd, const std::string& batch, size_t count, std::string& in,
+                      ConnectionResult& result) {
+    sendAll(fd, batch);
+    size_t replies = 0;
+    size_t parsed = 0;
+    char buf[64 * 1024];
+    while (replies < count) {
+        bool hit = false;
+        size_t len = parseReply(protocol, std::string_view(in).substr(parsed), hit);
+        if (len > 0) {
+            parsed += len;
+            replies += 1;
+            result.hits += hit;
+            continue;
+        }
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            throw std::runtime_error("Connection closed by server.");
+        }
+        in.append(buf, n);
+    }
+    in.erase(0, parsed);
+}
+
+static std::string keyOf(uint64_t key) {
+    return "key:" + std::to_string(key);
+}
+
+static void appendBulk(std::string& batch, std::string_view data) {
+    char buf[24];
+    buf[0] = '$';
+    auto [end, ec] = std::to_chars(buf + 1, buf + sizeof(buf) - 2, data.size());
+    *end++ = '\r';
+    *end++ = '\n';
+    batch.append(buf, end - buf);
+    batch += data;
+    batch += "\r\n";
+}
+
+static void appendGet(Protocol protocol, std::string& batch, uint64_t key) {
+    if (protocol == Protocol::Resp) {
+        batch += "*2\r\n$3\r\nGET\r\n";
+        appendBulk(batch, keyOf(key));
+    } else {
+        batch += "get " + keyOf(key) + "\r\n";
+    }
+}
+
+static void appendSet(Protocol protocol, std::string& batch, uint64_t key, const std::string& value) {
+    if (protocol == Protocol::Resp) {
+        batch += "*3\r\n$3\r\nSET\r\n";
+        appendBulk(batch, keyOf(key));
+        appendBulk(batch, value);
+    } else {
+        batch += "set " + keyOf(key) + " 0 0 " + std::to_string(value.size()) + "\r\n";
+        batch += value;
+        batch += "\r\n";
+    }
+}
+
+static void run(const Options& options, size_t index, ConnectionResult& result) {
+    int fd = connectTo(options);
+    std::string value(options.valueBytes, 'x');
+    std::string in;
+    std::string batch;
+
+    if (options.warm) {
+        // every connection stores its slice of the key space once
+        uint64_t begin = options.keys * index / options.connections;
+        uint64_t end = options.keys * (index + 1) / options.connections;
+        for (uint64_t key = begin; key < end; key += options.depth) {
+            batch.clear();
+            uint64_t last = std::min<uint64_t>(key + options.depth, end);
+            for (uint64_t k = key; k < last; ++k) {
+                appendSet(options.protocol, batch, k, value);
+            }
+            ConnectionResult ignored;
+            roundTrip(options.protocol, fd, batch, last - key, in, ignored);
+        }
+    }
+
+    std::vector<uint64_t> keys = workloads::zipf(options.requests, options.keys, options.skew, index + 1);
+    SplitMix64 rng(index + 1000);
+    for (size_t i = 0; i < keys.size(); i += options.depth) {
+        batch.clear();
+        size_t count = std::min(options.depth, keys.size() - i);
+        for (size_t j = i; j < i + count; ++j) {
+            if (rng.unit() < options.getRatio) {
+                appendGet(options.protocol, batch, keys[j]);
+                result.gets += 1;
+            } else {
+                appendSet(options.protocol, batch, keys[j], value);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        roundTrip(options.protocol, fd, batch, count, in, result);
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        result.batchNs.record(ns.count());
+        result.requests += count;
+    }
+    close(fd);
+}
+
+static void usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [-P memcached|resp] [-H 127.0.0.1] [-p port | -s unix socket path]"
+              << " [-c connections] [-n requests] [-k keys] [-z skew] [-r get ratio] [-v value bytes]"
+              << " [-d pipeline depth] [-W]\n";
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-P" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name != "memcached" && name != "resp") {
+                usage(argv[0]);
+                return 1;
+            }
+            options.protocol = name == "resp" ? Protocol::Resp : Protocol::Memcached;
+        } else if (arg == "-H" && i + 1 < argc) {
+            options.host = argv[++i];
+        } else if (arg == "-p" && i + 1 < argc) {
+            options.port = static_cast<uint16_t>(std::stoul(argv[++i]));
+        } else if (arg == "-s" && i + 1 < argc) {
+            options.unixPath = argv[++i];
+        } else if (arg == "-c" && i + 1 < argc) {
+            options.connections = std::stoull(argv[++i]);
+        } else if (arg == "-n" && i + 1 < argc) {
+            options.requests = std::stoull(argv[++i]);
+        } else if (arg == "-k" && i + 1 < argc) {
+            options.keys = std::stoull(argv[++i]);
+        } else if (arg == "-z" && i + 1 < argc) {
+            options.skew = std::stod(argv[++i]);
+        } else if (arg == "-r" && i + 1 < argc) {
+            options.getRatio = std::stod(argv[++i]);
+        } else if (arg == "-v" && i + 1 < argc) {
+            options.valueBytes = std::stoull(argv[++i]);
+        } else if (arg == "-d" && i + 1 < argc) {
+            options.depth = std::stoull(argv[++i]);
+        } else if (arg == "-W") {
+            options.warm = false;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.connections == 0 || options.depth == 0 || options.keys == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (options.port == 0) {
+        options.port = options.protocol == Protocol::Resp ? 6379 : 11211;
+    }
+
+    std::vector<ConnectionResult> results(options.connections);
+    std::vector<std::thread> threads;
+    std::atomic<bool> failed {false};
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < options.connections; ++i) {
+        threads.emplace_back([&, i] {
+            try {
+                run(options, i, results[i]);
+            } catch (const std::exception& e) {
+                std::cerr << "connection " << i << ": " << e.what() << "\n";
+                failed = true;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ConnectionResult total;
+    for (const auto& result : results) {
+        total.gets += result.gets;
+        total.hits += result.hits;
+        total.requests += result.requests;
+        total.batchNs.merge(result.batchNs);
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "requests     " << total.requests << "\n"
+              << "seconds      " << seconds << " (including warm up)\n"
+              << "Kops/s       " << (seconds > 0 ? total.requests / seconds / 1e3 : 0.0) << "\n"
+              << "hit ratio    " << std::setprecision(4)
+              << (total.gets ? static_cast<double>(total.hits) / total.gets : 0.0) << "\n"
+              << std::setprecision(1)
+              << "batch p50    " << total.batchNs.percentile(0.5) / 1e3 << " us\n"
+              << "batch p99    " << total.batchNs.percentile(0.99) / 1e3 << " us\n"
+              << "batch p999   " << total.batchNs.percentile(0.999) / 1e3 << " us\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+// random get()s over a large LFUCache with its storage from the default heap, from an Arena on 4K pages and
+// from an Arena on huge pages. reports ns per get and, where perf events are allowed
+// (perf_event_paranoid <= 2 or CAP_PERFMON), dTLB load misses per get
+//
+//   usage: tlb_bench [-c capacity] [-n gets]
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../Arena.h"
+#include "../LFUCache.h"
+#include "../tools/Workloads.h"
+
+// one hardware counter on the calling thread, value() is -1 when the kernel would not open it
+class PerfCounter {
+public:
+    PerfCounter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        mFd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~PerfCounter() {
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    }
+
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    void start() {
+        if (mFd >= 0) {
+            ioctl(mFd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(mFd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void stop() {
+        if (mFd >= 0) {
+            ioctl(mFd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    int64_t value() const {
+        uint64_t count = 0;
+        if (mFd < 0 || read(mFd, &count, sizeof(count)) != sizeof(count)) {
+            return -1;
+        }
+        return static_cast<int64_t>(count);
+    }
+
+private:
+    int mFd;
+};
+
+template<typename Cache>
+static void run(const std::string& name, Cache& cache, size_t capacity, const std::vector<uint64_t>& keys,
+                const Arena* arena) {
+    for (uint64_t key = 0; key < capacity; ++key) {
+        cache.put(key, key);
+    }
+
+    PerfCounter dtlbMisses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                               | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    dtlbMisses.start();
+    for (uint64_t key : keys) {
+        if (uint64_t* val = cache.find(key)) {
+            sum += *val;
+        }
+    }
+    dtlbMisses.stop();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double gets = static_cast<double>(keys.size());
+    std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << seconds * 1e9 / gets;
+    int64_t misses = dtlbMisses.value();
+    if (misses >= 0) {
+        std::cout << std::setw(16) << std::setprecision(3) << misses / gets;
+    } else {
+        std::cout << std::setw(16) << "n/a";
+    }
+    if (arena != nullptr) {
+        std::cout << std::setw(14) << arena->reservedBytes() / (1024 * 1024) << std::setw(14)
+                  << arena->hugeTlbBytes() / (1024 * 1024);
+    }
+    std::cout << "    (checksum " << sum % 1000 << ")\n";
+}
+
+template<typename Alloc = std::allocator<std::pair<const uint64_t, uint64_t>>>
+using Cache = LFUCache<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, Alloc>;
+
+using ArenaCache = Cache<ArenaAllocator<std::pair<const uint64_t, uint64_t>>>;
+
+int main(int argc, char** argv) {
+    size_t capacity = 10'000'000;
+    size_t gets = 20'000'000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-c" && i + 1 < argc) {
+            capacity = std::stoull(argv[++i]);
+        } else if (arg == "-n" && i + 1 < argc) {
+            gets = std::stoull(argv[++i]);
+        } else {
+            std::cerr << "usage: " << argv[0] << " [-c capacity] [-n gets]\n";
+            return 1;
+        }
+    }
+
+    // uniform over the cached keys, so every get is a hit and the working set is the whole cache
+    std::vector<uint64_t> keys = workloads::uniform(gets, capacity);
+
+    std::cout << capacity << " entries, " << gets << " random gets\n\n";
+    std::cout << std::left << std::setw(16) << "storage" << std::right << std::setw(12) << "ns/get"
+              << std::setw(16) << "dTLB miss/get" << std::setw(14) << "mapped MB" << std::setw(14) << "hugetlb MB"
+              << "\n";
+    {
+        Cache<> cache(capacity);
+        run("heap", cache, capacity, keys, nullptr);
+    }
+    {
+        Arena arena;
+        ArenaCache cache(capacity, {}, {}, ArenaAllocator<std::pair<const uint64_t, uint64_t>>(arena));
+        run("arena 4K", cache, capacity, keys, &arena);
+    }
+    {
+        Arena arena(Arena::Options {.hugePages = true});
+        ArenaCache cache(capacity, {}, {}, ArenaAllocator<std::pair<const uint64_t, uint64_t>>(arena));
+        run("arena 2M", cache, capacity, keys, &arena);
+    }
+    return 0;
+}
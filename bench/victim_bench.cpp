@@ -0,0 +1,139 @@
+// cost of picking an eviction victim: the victim_select kernels over sampled windows of 8 and 16 bit
+// counters, then evict() itself on LFUCache (walk to the min frequency list and unlink its tail) against
+// SampledLFUCache (scan a window of frequencies and stamps) on caches warmed with the same zipf stream, then
+// a bulk load of new keys into a full LFUCache that evicts one key per insert or in batches down to a low watermark
+//
+//   usage: victim_bench [-c capacity] [-n evictions]
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../LFUCache.h"
+#include "../SampledLFUCache.h"
+#include "../VictimSelect.h"
+#include "../tools/Workloads.h"
+
+template<typename Fn>
+static double nsPerCall(size_t calls, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; ++i) {
+        fn(i);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+}
+
+template<typename Counter>
+static void kernels(const std::string& counterName) {
+    constexpr size_t Slots = 1 << 20;
+    constexpr size_t Calls = 2'000'000;
+    SplitMix64 rng(7);
+    std::vector<Counter> freqs(Slots);
+    std::vector<uint32_t> stamps(Slots);
+    for (size_t i = 0; i < Slots; ++i) {
+        freqs[i] = static_cast<Counter>(1 + rng.below(8));
+        stamps[i] = static_cast<uint32_t>(rng.next());
+    }
+
+    std::vector<std::pair<std::string, victim_select::Kernel<Counter>>> candidates {
+        {"scalar", &victim_select::scalar<Counter>}};
+#ifdef LFU_CACHE_X86_KERNELS
+    if (__builtin_cpu_supports("sse4.1")) {
+        candidates.emplace_back("sse4.1", &victim_select::sse41<Counter>);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        candidates.emplace_back("avx2", &victim_select::avx2<Counter>);
+    }
+#endif
+
+    for (uint32_t window : {16u, 32u, 64u}) {
+        std::vector<uint32_t> starts(Calls);
+        for (auto& start : starts) {
+            start = static_cast<uint32_t>(rng.below(Slots - window));
+        }
+        for (const auto& [name, kernel] : candidates) {
+            uint64_t sum = 0;
+            double ns = nsPerCall(Calls, [&](size_t i) {
+                sum += kernel(freqs.data() + starts[i], stamps.data() + starts[i], window, 0);
+            });
+            std::cout << std::left << std::setw(10) << counterName << std::setw(10) << name << std::right
+                      << std::setw(8) << window << std::fixed << std::setprecision(2) << std::setw(12) << ns
+                      << "    (checksum " << sum % 1000 << ")\n";
+        }
+    }
+}
+
+// fills cache with a zipf stream over twice its capacity, then times evictions
+template<typename Cache>
+static void evictions(const std::string& name, Cache& cache, size_t capacity, size_t count) {
+    std::vector<uint64_t> keys = workloads::zipf(capacity * 8, capacity * 2, 0.9);
+    for (uint64_t key : keys) {
+        if (cache.find(key) == nullptr) {
+            cache.put(key, key);
+        }
+    }
+    double ns = nsPerCall(count, [&](size_t) { cache.evict(); });
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << ns << "\n";
+}
+
+// warms cache with the zipf stream evictions() uses, so batches run across many frequency lists, then times
+// putting count keys it has never seen
+static void bulkLoad(const std::string& name, size_t capacity, size_t low, size_t count) {
+    LFUCache<uint64_t, uint64_t> cache(capacity);
+    cache.setLowWatermark(low);
+    for (uint64_t key : workloads::zipf(capacity * 8, capacity * 2, 0.9)) {
+        if (cache.find(key) == nullptr) {
+            cache.put(key, key);
+        }
+    }
+    double ns = nsPerCall(count, [&](size_t i) { cache.put(capacity * 2 + i, i); });
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << ns << "\n";
+}
+
+int main(int argc, char** argv) {
+    size_t capacity = 1'000'000;
+    size_t count = 500'000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-c" && i + 1 < argc) {
+            capacity = std::stoull(argv[++i]);
+        } else if (arg == "-n" && i + 1 < argc) {
+            count = std::stoull(argv[++i]);
+        } else {
+            std::cerr << "usage: " << argv[0] << " [-c capacity] [-n evictions]\n";
+            return 1;
+        }
+    }
+    count = std::min(count, capacity);
+
+    std::cout << "victim selection, ns per window\n";
+    std::cout << std::left << std::setw(10) << "counter" << std::setw(10) << "kernel" << std::right
+              << std::setw(8) << "window" << std::setw(12) << "ns" << "\n";
+    kernels<uint8_t>("uint8");
+    kernels<uint16_t>("uint16");
+
+    std::cout << "\n" << count << " evictions from a full cache of " << capacity << ", ns per evict()\n";
+    {
+        LFUCache<uint64_t, uint64_t> cache(capacity);
+        evictions("LFUCache", cache, capacity, count);
+    }
+    for (uint32_t window : {16u, 64u}) {
+        SampledLFUCache<uint64_t, uint64_t> cache(capacity, window);
+        evictions("SampledLFUCache/16 bit/" + std::to_string(window), cache, capacity, count);
+        SampledLFUCache<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>, uint8_t> small(
+            capacity, window);
+        evictions("SampledLFUCache/8 bit/" + std::to_string(window), small, capacity, count);
+    }
+
+    std::cout << "\n" << count << " new keys put into a full LFUCache, ns per put()\n";
+    bulkLoad("one per insert", capacity, capacity - 1, count);
+    for (size_t percent : {99, 95, 90}) {
+        bulkLoad("low watermark " + std::to_string(percent) + "%", capacity, capacity * percent / 100, count);
+    }
+    return 0;
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+// memcached text protocol: get, gets, set, delete, stats, version and quit.
+// exptime is accepted and ignored, the cache does not expire entries
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+#include <unistd.h>
+
+#include "Server.h"
+
+class MemcachedHandler {
+public:
+    static constexpr size_t MaxKeyLength = 250;
+    static constexpr size_t MaxLineLength = 4096;
+    static constexpr size_t MaxValueLength = 1024 * 1024;
+
+    MemcachedHandler(ServerState& state, LoopStats& stats) : mState(state), mStats(stats) {}
+
+    size_t operator()(std::string_view input, OutputBuffer& output, bool& close) {
+        size_t consumed = 0;
+        while (!close) {
+            size_t eol = input.find("\r\n", consumed);
+            if (eol == std::string_view::npos) {
+                if (input.size() - consumed > MaxLineLength) {
+                    output += "CLIENT_ERROR line too long\r\n";
+                    close = true;
+                    return input.size();
+                }
+                break;
+            }
+
+            size_t used = handleLine(input.substr(consumed, eol - consumed), input.substr(eol + 2), output, close);
+            if (used == NeedMore) {
+                break;
+            }
+            consumed = eol + 2 + used;
+        }
+        return consumed;
+    }
+
+private:
+    static constexpr size_t NeedMore = static_cast<size_t>(-1);
+    static constexpr size_t MaxTokens = 24;
+
+    struct Tokens {
+        std::array<std::string_view, MaxTokens> items;
+        size_t count = 0;
+        std::string_view rest; // the line past the first MaxTokens tokens, empty if they were all of it
+    };
+
+    static Tokens tokenize(std::string_view line) {
+        Tokens tokens;
+        size_t pos = 0;
+        while (pos < line.size()) {
+            size_t start = line.find_first_not_of(' ', pos);
+            if (start == std::string_view::npos) {
+                break;
+            }
+            if (tokens.count == MaxTokens) {
+                tokens.rest = line.substr(start);
+                break;
+            }
+            size_t end = line.find(' ', start);
+            if (end == std::string_view::npos) {
+                end = line.size();
+            }
+            tokens.items[tokens.count++] = line.substr(start, end - start);
+            pos = end;
+        }
+        return tokens;
+    }
+
+    template<typename T>
+    static bool parse(std::string_view token, T& value) {
+        auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+        return ec == std::errc() && ptr == token.data() + token.size();
+    }
+
+    // handles one command line, rest is the input after its \r\n. returns how much of rest the command
+    // used (a set's data block) or NeedMore if that is not complete yet
+    size_t handleLine(std::string_view line, std::string_view rest, OutputBuffer& output, bool& close) {
+        Tokens tokens = tokenize(line);
+        if (tokens.count == 0) {
+            output += "ERROR\r\n";
+            return 0;
+        }
+
+        std::string_view cmd = tokens.items[0];
+        if (cmd == "get" || cmd == "gets") {
+            get(tokens, cmd == "gets", output);
+            return 0;
+        }
+        if (!tokens.rest.empty()) {
+            // only get takes more than a few arguments
+            output += "CLIENT_ERROR bad command line format\r\n";
+            return 0;
+        }
+        if (cmd == "set") {
+            return set(tokens, rest, output, close);
+        }
+        if (cmd == "delete") {
+            del(tokens, output);
+            return 0;
+        }
+        if (cmd == "stats") {
+            stats(output);
+            return 0;
+        }
+        if (cmd == "version") {
+            output += "VERSION lfu_cache-0.1.0\r\n";
+            return 0;
+        }
+        if (cmd == "quit") {
+            close = true;
+            return 0;
+        }
+        output += "ERROR\r\n";
+        return 0;
+    }
+
+    // like memcached, keys past the first MaxTokens tokens are tokenized and looked up a chunk at a time
+    void get(Tokens tokens, bool withCas, OutputBuffer& output) {
+        if (tokens.count < 2) {
+            output += "ERROR\r\n"; // a get needs at least one key, memcached rejects it like an unknown command
+            return;
+        }
+        for (size_t first = 1;; first = 0) {
+            for (size_t i = first; i < tokens.count; ++i) {
+                getOne(tokens.items[i], withCas, output);
+            }
+            if (tokens.rest.empty()) {
+                break;
+            }
+            tokens = tokenize(tokens.rest);
+        }
+        output += "END\r\n";
+    }
+
+    void getOne(std::string_view key, bool withCas, OutputBuffer& output) {
+        LoopStats::add(mStats.cmdGet);
+        // the reply is written straight from the cached item while its shard is locked, nothing is copied twice
+        bool hit = mState.cache.find(key, [&](const CacheItem& item) {
+            output += "VALUE ";
+            output += key;
+            appendNumber(output, item.flags);
+            appendNumber(output, item.data.size());
+            if (withCas) {
+                appendNumber(output, item.cas);
+            }
+            output += "\r\n";
+            output += item.data;
+            output += "\r\n";
+        });
+        LoopStats::add(hit ? mStats.getHits : mStats.getMisses);
+    }
+
+    size_t set(const Tokens& tokens, std::string_view rest, OutputBuffer& output, bool& close) {
+        uint32_t flags = 0;
+        int64_t exptime = 0;
+        size_t bytes = 0;
+        bool noreply = tokens.count == 6 && tokens.items[5] == "noreply";
+        if ((tokens.count != 5 && !noreply) || !parse(tokens.items[2], flags) || !parse(tokens.items[3], exptime)
+            || !parse(tokens.items[4], bytes)) {
+            output += "CLIENT_ERROR bad command line format\r\n";
+            return 0;
+        }
+        if (bytes > MaxValueLength) {
+            // rather than buffering a data block that will be thrown away anyway
+            output += "SERVER_ERROR object too large for cache\r\n";
+            close = true;
+            return 0;
+        }
+        if (rest.size() < bytes + 2) {
+            return NeedMore;
+        }
+        if (tokens.items[1].size() > MaxKeyLength) {
+            output += "CLIENT_ERROR key too long\r\n";
+            return bytes + 2;
+        }
+        if (rest.substr(bytes, 2) != "\r\n") {
+            output += "CLIENT_ERROR bad data chunk\r\n";
+            return bytes + 2;
+        }
+
+        LoopStats::add(mStats.cmdSet);
+        uint64_t cas = mState.nextCas.fetch_add(1, std::memory_order_relaxed);
+        mState.cache.put(std::string(tokens.items[1]), CacheItem {flags, cas, std::string(rest.substr(0, bytes))});
+        if (!noreply) {
+            output += "STORED\r\n";
+        }
+        return bytes + 2;
+    }
+
+    void del(const Tokens& tokens, OutputBuffer& output) {
+        bool noreply = tokens.count == 3 && tokens.items[2] == "noreply";
+        if (tokens.count != 2 && !noreply) {
+            output += "CLIENT_ERROR bad command line format\r\n";
+            return;
+        }
+        bool deleted = mState.cache.erase(tokens.items[1]);
+        LoopStats::add(deleted ? mStats.deleteHits : mStats.deleteMisses);
+        if (!noreply) {
+            output += deleted ? "DELETED\r\n" : "NOT_FOUND\r\n";
+        }
+    }
+
+    void stats(OutputBuffer& output) {
+        auto stat = [&](std::string_view name, uint64_t value) {
+            output += "STAT ";
+            output += name;
+            appendNumber(output, value);
+            output += "\r\n";
+        };
+        auto uptime = std::chrono::steady_clock::now() - mState.start;
+        stat("pid", getpid());
+        stat("uptime", std::chrono::duration_cast<std::chrono::seconds>(uptime).count());
+        stat("threads", mState.stats.size());
+        stat("curr_connections", mState.sum(&LoopStats::currConnections));
+        stat("total_connections", mState.sum(&LoopStats::totalConnections));
+        stat("cmd_get", mState.sum(&LoopStats::cmdGet));
+        stat("cmd_set", mState.sum(&LoopStats::cmdSet));
+        stat("get_hits", mState.sum(&LoopStats::getHits));
+        stat("get_misses", mState.sum(&LoopStats::getMisses));
+        stat("delete_hits", mState.sum(&LoopStats::deleteHits));
+        stat("delete_misses", mState.sum(&LoopStats::deleteMisses));
+        stat("bytes_read", mState.sum(&LoopStats::bytesRead));
+        stat("bytes_written", mState.sum(&LoopStats::bytesWritten));
+        stat("curr_items", mState.cache.size());
+        stat("limit_maxitems", mState.cache.capacity());
+        stat("shards", mState.cache.shardCount());
+        output += "END\r\n";
+    }
+
+    // " <value>"
+    static void appendNumber(OutputBuffer& output, uint64_t value) {
+        char buf[24];
+        buf[0] = ' ';
+        auto [end, ec] = std::to_chars(buf + 1, buf + sizeof(buf), value);
+        output.append(buf, end - buf);
+    }
+
+    ServerState& mState;
+    LoopStats& mStats;
+};
@@ -0,0 +1,334 @@
+#pragma once
+
+// RESP (redis protocol) frontend: GET, SET, MGET, DEL, INFO, PING, COMMAND and QUIT, as arrays of bulk
+// strings or inline commands. SET accepts and ignores EX / PX, the cache does not expire entries
+
+#include <charconv>
+#include <chrono>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Server.h"
+
+class RespHandler {
+public:
+    static constexpr size_t MaxArgs = 1024 * 1024;
+    static constexpr size_t MaxBulkLength = 1024 * 1024;
+    // bytes of one command, however it is split into arguments. a connection buffers at most this much for a
+    // command that has not fully arrived, the same limit as redis' proto-max-bulk-len
+    static constexpr size_t MaxCommandBytes = 512 * 1024 * 1024;
+    static constexpr size_t MaxInlineLength = 64 * 1024;
+    static constexpr size_t InlineValueLimit = 256; // shorter values are copied into the reply, longer ones sent as is
+
+    RespHandler(ServerState& state, LoopStats& stats) : mState(state), mStats(stats) {}
+
+    // parses every complete command in input first, the arguments stay views into input, then runs them
+    size_t operator()(std::string_view input, OutputBuffer& output, bool& close) {
+        mArgs.clear();
+        mCommands.clear();
+
+        size_t consumed = 0;
+        std::string_view error;
+        while (consumed < input.size()) {
+            size_t argsBegin = mArgs.size();
+            size_t next = parseCommand(input, consumed, error);
+            if (next == 0) {
+                mArgs.resize(argsBegin);
+                break;
+            }
+            if (mArgs.size() > argsBegin) {
+                mCommands.push_back({argsBegin, mArgs.size() - argsBegin});
+            }
+            consumed = next;
+        }
+
+        execute(output, close);
+        if (!error.empty() && !close) {
+            output += "-ERR Protocol error: ";
+            output += error;
+            output += "\r\n";
+            close = true;
+            return input.size();
+        }
+        return consumed;
+    }
+
+private:
+    struct Command {
+        size_t argsBegin;
+        size_t argCount;
+    };
+
+    // position after the command starting at pos, 0 if it is incomplete or malformed (error is set then)
+    size_t parseCommand(std::string_view input, size_t pos, std::string_view& error) {
+        if (input[pos] != '*') {
+            return parseInline(input, pos, error);
+        }
+
+        size_t count = 0;
+        size_t next = parseLength(input, pos + 1, count, error);
+        if (next == 0) {
+            return 0;
+        }
+        if (count > MaxArgs) {
+            error = "invalid multibulk length";
+            return 0;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (next >= input.size()) {
+                return 0;
+            }
+            if (input[next] != '$') {
+                error = "expected '$'";
+                return 0;
+            }
+            size_t length = 0;
+            next = parseLength(input, next + 1, length, error);
+            if (next == 0) {
+                return 0;
+            }
+            if (length > MaxBulkLength) {
+                error = "invalid bulk length";
+                return 0;
+            }
+            if (next - pos + length + 2 > MaxCommandBytes) {
+                error = "too big multibulk request";
+                return 0;
+            }
+            if (input.size() < next + length + 2) {
+                return 0;
+            }
+            if (input.substr(next + length, 2) != "\r\n") {
+                error = "expected CRLF after bulk string";
+                return 0;
+            }
+            mArgs.push_back(input.substr(next, length));
+            next += length + 2;
+        }
+        return next;
+    }
+
+    // number up to \r\n starting at pos, returns the position after the \r\n
+    static size_t parseLength(std::string_view input, size_t pos, size_t& value, std::string_view& error) {
+        size_t eol = input.find("\r\n", pos);
+        if (eol == std::string_view::npos) {
+            if (input.size() - pos > 32) {
+                error = "invalid length";
+            }
+            return 0;
+        }
+        auto [ptr, ec] = std::from_chars(input.data() + pos, input.data() + eol, value);
+        if (ec != std::errc() || ptr != input.data() + eol) {
+            error = "invalid length";
+            return 0;
+        }
+        return eol + 2;
+    }
+
+    // space separated words up to \r\n or \n, as typed into telnet
+    size_t parseInline(std::string_view input, size_t pos, std::string_view& error) {
+        size_t eol = input.find('\n', pos);
+        if (eol == std::string_view::npos) {
+            if (input.size() - pos > MaxInlineLength) {
+                error = "too big inline request";
+            }
+            return 0;
+        }
+        std::string_view line = input.substr(pos, eol - pos);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        while (!line.empty()) {
+            size_t start = line.find_first_not_of(' ');
+            if (start == std::string_view::npos) {
+                break;
+            }
+            size_t end = std::min(line.find(' ', start), line.size());
+            mArgs.push_back(line.substr(start, end - start));
+            line.remove_prefix(end);
+        }
+        return eol + 1;
+    }
+
+    static bool is(std::string_view arg, std::string_view name) {
+        if (arg.size() != name.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < arg.size(); ++i) {
+            if ((arg[i] | 0x20) != name[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool isRead(std::span<const std::string_view> args) {
+        return (is(args[0], "get") && args.size() == 2) || (is(args[0], "mget") && args.size() >= 2);
+    }
+
+    std::span<const std::string_view> argsOf(const Command& command) const {
+        return std::span<const std::string_view>(mArgs).subspan(command.argsBegin, command.argCount);
+    }
+
+    void execute(OutputBuffer& output, bool& close) {
+        for (size_t i = 0; i < mCommands.size() && !close;) {
+            if (isRead(argsOf(mCommands[i]))) {
+                // a run of reads is looked up in one go, one lock per shard for the whole run
+                size_t end = i + 1;
+                while (end < mCommands.size() && isRead(argsOf(mCommands[end]))) {
+                    ++end;
+                }
+                executeReads(i, end, output);
+                i = end;
+            } else {
+                executeOne(argsOf(mCommands[i]), output, close);
+                ++i;
+            }
+        }
+    }
+
+    void executeReads(size_t begin, size_t end, OutputBuffer& output) {
+        mKeys.clear();
+        for (size_t i = begin; i < end; ++i) {
+            auto args = argsOf(mCommands[i]);
+            mKeys.insert(mKeys.end(), args.begin() + 1, args.end());
+        }
+        mValues.resize(mKeys.size());
+        mFound.assign(mKeys.size(), false);
+
+        mState.cache.findMany(std::span<const std::string_view>(mKeys), [&](size_t i, const CacheItem& item) {
+            mValues[i].assign(item.data);
+            mFound[i] = true;
+        });
+
+        size_t key = 0;
+        for (size_t i = begin; i < end; ++i) {
+            auto args = argsOf(mCommands[i]);
+            if (is(args[0], "mget")) {
+                appendHeader(output, '*', args.size() - 1);
+            }
+            for (size_t j = 1; j < args.size(); ++j, ++key) {
+                LoopStats::add(mStats.cmdGet);
+                LoopStats::add(mFound[key] ? mStats.getHits : mStats.getMisses);
+                if (!mFound[key]) {
+                    output += "$-1\r\n";
+                    continue;
+                }
+                appendHeader(output, '$', mValues[key].size());
+                if (mValues[key].size() < InlineValueLimit) {
+                    output += mValues[key];
+                } else {
+                    output.appendChunk(std::move(mValues[key]));
+                    mValues[key] = std::string();
+                }
+                output += "\r\n";
+            }
+        }
+    }
+
+    void executeOne(std::span<const std::string_view> args, OutputBuffer& output, bool& close) {
+        std::string_view cmd = args[0];
+        if (is(cmd, "set")) {
+            set(args, output);
+        } else if (is(cmd, "del") && args.size() >= 2) {
+            uint64_t deleted = 0;
+            for (std::string_view key : args.subspan(1)) {
+                bool hit = mState.cache.erase(key);
+                LoopStats::add(hit ? mStats.deleteHits : mStats.deleteMisses);
+                deleted += hit;
+            }
+            appendHeader(output, ':', deleted);
+        } else if (is(cmd, "info")) {
+            info(output);
+        } else if (is(cmd, "ping")) {
+            if (args.size() > 1) {
+                appendBulk(output, args[1]);
+            } else {
+                output += "+PONG\r\n";
+            }
+        } else if (is(cmd, "command")) {
+            output += "*0\r\n"; // redis-cli asks on connect, an empty list is enough
+        } else if (is(cmd, "quit")) {
+            output += "+OK\r\n";
+            close = true;
+        } else if (is(cmd, "get") || is(cmd, "mget") || is(cmd, "del")) {
+            output += "-ERR wrong number of arguments for '";
+            output += cmd;
+            output += "' command\r\n";
+        } else {
+            output += "-ERR unknown command '";
+            output += cmd;
+            output += "'\r\n";
+        }
+    }
+
+    // SET key value [EX seconds | PX milliseconds]
+    void set(std::span<const std::string_view> args, OutputBuffer& output) {
+        if (args.size() != 3 && !(args.size() == 5 && (is(args[3], "ex") || is(args[3], "px")))) {
+            output += "-ERR syntax error\r\n";
+            return;
+        }
+        LoopStats::add(mStats.cmdSet);
+        uint64_t cas = mState.nextCas.fetch_add(1, std::memory_order_relaxed);
+        mState.cache.put(std::string(args[1]), CacheItem {0, cas, std::string(args[2])});
+        output += "+OK\r\n";
+    }
+
+    void info(OutputBuffer& output) {
+        std::string text;
+        auto field = [&](std::string_view name, uint64_t value) {
+            text += name;
+            text += ':';
+            text += std::to_string(value);
+            text += "\r\n";
+        };
+        auto uptime = std::chrono::steady_clock::now() - mState.start;
+        text += "# Server\r\nlfu_cache_version:0.1.0\r\n";
+        field("process_id", getpid());
+        field("uptime_in_seconds", std::chrono::duration_cast<std::chrono::seconds>(uptime).count());
+        field("io_threads", mState.stats.size());
+        text += "# Clients\r\n";
+        field("connected_clients", mState.sum(&LoopStats::currConnections));
+        text += "# Stats\r\n";
+        field("total_connections_received", mState.sum(&LoopStats::totalConnections));
+        field("keyspace_hits", mState.sum(&LoopStats::getHits));
+        field("keyspace_misses", mState.sum(&LoopStats::getMisses));
+        field("total_net_input_bytes", mState.sum(&LoopStats::bytesRead));
+        field("total_net_output_bytes", mState.sum(&LoopStats::bytesWritten));
+        text += "# Keyspace\r\n";
+        text += "db0:keys=" + std::to_string(mState.cache.size()) + "\r\n";
+        field("maxkeys", mState.cache.capacity());
+        field("shards", mState.cache.shardCount());
+        appendBulk(output, text);
+    }
+
+    // "<type><value>\r\n"
+    static void appendHeader(OutputBuffer& output, char type, uint64_t value) {
+        char buf[24];
+        buf[0] = type;
+        auto [end, ec] = std::to_chars(buf + 1, buf + sizeof(buf) - 2, value);
+        *end++ = '\r';
+        *end++ = '\n';
+        output.append(buf, end - buf);
+    }
+
+    static void appendBulk(OutputBuffer& output, std::string_view data) {
+        appendHeader(output, '$', data.size());
+        output += data;
+        output += "\r\n";
+    }
+
+    ServerState& mState;
+    LoopStats& mStats;
+
+    // scratch reused across calls, so a pipeline does not allocate once it has been seen
+    std::vector<std::string_view> mArgs;
+    std::vector<Command> mCommands;
+    std::vector<std::string_view> mKeys;
+    std::vector<std::string> mValues;
+    std::vector<bool> mFound;
+};
@@ -0,0 +1,377 @@
+#pragma once
+
+// epoll server plumbing shared by the protocol frontends of lfu_server, linux only
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../ShardedLFUCache.h"
+
+// what the server caches per key, flags are opaque to the server and handed back with the data
+struct CacheItem {
+    uint32_t flags = 0;
+    uint64_t cas = 0;
+    std::string data;
+};
+
+using ServerCache = ShardedLFUCache<std::string, CacheItem>;
+
+// counters of one event loop, summed over all loops for the stats command
+struct alignas(64) LoopStats {
+    std::atomic<uint64_t> currConnections {0};
+    std::atomic<uint64_t> totalConnections {0};
+    std::atomic<uint64_t> cmdGet {0};
+    std::atomic<uint64_t> cmdSet {0};
+    std::atomic<uint64_t> getHits {0};
+    std::atomic<uint64_t> getMisses {0};
+    std::atomic<uint64_t> deleteHits {0};
+    std::atomic<uint64_t> deleteMisses {0};
+    std::atomic<uint64_t> bytesRead {0};
+    std::atomic<uint64_t> bytesWritten {0};
+
+    // only the owning loop writes, so a relaxed load and store is enough
+    static void add(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+// state every loop shares: the cache, the stats of all loops and the cas counter
+struct ServerState {
+    ServerState(size_t capacity, size_t shards, size_t loops)
+        : cache(capacity, shards), stats(loops), start(std::chrono::steady_clock::now()) {}
+
+    ServerCache cache;
+    std::vector<LoopStats> stats;
+    std::atomic<uint64_t> nextCas {1};
+    std::chrono::steady_clock::time_point start;
+
+    uint64_t sum(std::atomic<uint64_t> LoopStats::* counter) const {
+        uint64_t total = 0;
+        for (const LoopStats& loop : stats) {
+            total += (loop.*counter).load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+// non-blocking listening socket on host:port
+inline int listenTcp(const std::string& host, uint16_t port) {
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* result = nullptr;
+    std::string service = std::to_string(port);
+    if (int err = getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &result); err != 0) {
+        throw std::runtime_error("getaddrinfo: " + std::string(gai_strerror(err)));
+    }
+
+    int fd = -1;
+    for (addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot listen on " + host + ":" + service + ": " + std::strerror(errno));
+    }
+    return fd;
+}
+
+// non-blocking listening unix socket at path, a stale socket file is replaced
+inline int listenUnix(const std::string& path) {
+    sockaddr_un addr {};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Unix socket path too long: " + path);
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    }
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error("Cannot listen on " + path + ": " + std::strerror(err));
+    }
+    return fd;
+}
+
+// replies of one connection as a queue of owned chunks, sent with a single writev per flush. small pieces are
+// copied into the open chunk at the back, a whole string (e.g. a value copied out of the cache) can be handed
+// over by move and is sent from where it is instead of being copied into a contiguous buffer again
+class OutputBuffer {
+public:
+    OutputBuffer& operator+=(std::string_view bytes) {
+        if (!mTailOpen) {
+            mChunks.emplace_back();
+            mTailOpen = true;
+        }
+        mChunks.back() += bytes;
+        mSize += bytes.size();
+        return *this;
+    }
+
+    void append(const char* data, size_t size) {
+        *this += std::string_view(data, size);
+    }
+
+    void appendChunk(std::string&& chunk) {
+        mSize += chunk.size();
+        mChunks.push_back(std::move(chunk));
+        mTailOpen = false;
+    }
+
+    bool empty() const {
+        return mSize == 0;
+    }
+
+    // bytes not sent yet
+    size_t size() const {
+        return mSize;
+    }
+
+    // one writev of as many chunks as fit in an iovec array, returns what writev returned
+    ssize_t writeTo(int fd) {
+        iovec iov[MaxIov];
+        int count = 0;
+        size_t skip = mSent;
+        for (auto it = mChunks.begin(); it != mChunks.end() && count < MaxIov; ++it) {
+            iov[count].iov_base = it->data() + skip;
+            iov[count].iov_len = it->size() - skip;
+            skip = 0;
+            count += 1;
+        }
+        ssize_t n = writev(fd, iov, count);
+        if (n > 0) {
+            consume(n);
+        }
+        return n;
+    }
+
+private:
+    static constexpr int MaxIov = 64;
+
+    void consume(size_t n) {
+        mSize -= n;
+        while (n > 0) {
+            size_t left = mChunks.front().size() - mSent;
+            if (n < left) {
+                mSent += n;
+                return;
+            }
+            n -= left;
+            mSent = 0;
+            mChunks.pop_front();
+        }
+        if (mChunks.empty()) {
+            mTailOpen = false;
+        }
+    }
+
+    std::deque<std::string> mChunks;
+    size_t mSent = 0; // bytes of the front chunk already sent
+    size_t mSize = 0;
+    bool mTailOpen = false;
+};
+
+// one epoll loop per thread. every loop waits on the same listening socket (EPOLLEXCLUSIVE wakes one of them)
+// and keeps the connections it accepts, so a connection and its buffers are only ever touched by one thread.
+// Handler is called as handler(input, output, close) with all unconsumed input of a connection, appends the
+// replies of every complete request to output and returns how many bytes of input it consumed
+template<typename Handler>
+class EventLoop {
+public:
+    EventLoop(int listenFd, Handler handler, LoopStats& stats)
+        : mListenFd(listenFd), mEpollFd(epoll_create1(EPOLL_CLOEXEC)), mHandler(std::move(handler)), mStats(stats) {
+        if (mEpollFd < 0) {
+            throw std::runtime_error(std::string("epoll_create1: ") + std::strerror(errno));
+        }
+        epoll_event ev {};
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.fd = mListenFd;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mListenFd, &ev) != 0) {
+            throw std::runtime_error(std::string("epoll_ctl: ") + std::strerror(errno));
+        }
+    }
+
+    ~EventLoop() {
+        for (auto& [fd, conn] : mConnections) {
+            close(fd);
+        }
+        close(mEpollFd);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // serves until stop is set, checked at least every 100ms
+    void run(const std::atomic<bool>& stop) {
+        std::vector<epoll_event> events(256);
+        while (!stop.load(std::memory_order_relaxed)) {
+            int n = epoll_wait(mEpollFd, events.data(), static_cast<int>(events.size()), 100);
+            if (n < 0 && errno != EINTR) {
+                throw std::runtime_error(std::string("epoll_wait: ") + std::strerror(errno));
+            }
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == mListenFd) {
+                    acceptAll();
+                } else {
+                    serve(fd, events[i].events);
+                }
+            }
+        }
+    }
+
+private:
+    struct Connection {
+        std::string in;
+        OutputBuffer out;
+        uint32_t interest = EPOLLIN | EPOLLRDHUP; // events currently registered with epoll
+        bool closing = false; // close once out is sent
+    };
+
+    static constexpr size_t ReadChunk = 64 * 1024;
+    static constexpr size_t MaxPendingOutput = 16 * 1024 * 1024; // stop reading a client that does not read
+
+    void acceptAll() {
+        while (true) {
+            int fd = accept4(mListenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return; // EAGAIN, or another loop took it
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on unix sockets
+
+            epoll_event ev {};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.fd = fd;
+            if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                close(fd);
+                continue;
+            }
+            mConnections.try_emplace(fd);
+            LoopStats::add(mStats.currConnections);
+            LoopStats::add(mStats.totalConnections);
+        }
+    }
+
+    void serve(int fd, uint32_t events) {
+        auto it = mConnections.find(fd);
+        if (it == mConnections.end()) {
+            return;
+        }
+        Connection& conn = it->second;
+
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            drop(fd);
+            return;
+        }
+        if ((events & EPOLLIN) && !conn.closing) {
+            if (!readAndHandle(fd, conn)) {
+                drop(fd);
+                return;
+            }
+        }
+        if (!flush(fd, conn)) {
+            drop(fd);
+        }
+    }
+
+    // false once the peer has closed
+    bool readAndHandle(int fd, Connection& conn) {
+        size_t old = conn.in.size();
+        conn.in.resize(old + ReadChunk);
+        ssize_t n = read(fd, conn.in.data() + old, ReadChunk);
+        if (n <= 0) {
+            conn.in.resize(old);
+            return n < 0 && (errno == EAGAIN || errno == EINTR);
+        }
+        conn.in.resize(old + n);
+        LoopStats::add(mStats.bytesRead, n);
+
+        size_t consumed = mHandler(std::string_view(conn.in), conn.out, conn.closing);
+        conn.in.erase(0, consumed);
+        return true;
+    }
+
+    // writes what it can, false if the connection is done
+    bool flush(int fd, Connection& conn) {
+        while (!conn.out.empty()) {
+            ssize_t n = conn.out.writeTo(fd);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN) {
+                    return false;
+                }
+                break;
+            }
+            LoopStats::add(mStats.bytesWritten, n);
+        }
+
+        bool pending = !conn.out.empty();
+        if (!pending && conn.closing) {
+            return false;
+        }
+
+        // wait for the client to read its replies before taking more requests from it
+        bool reading = conn.out.size() < MaxPendingOutput;
+        uint32_t in = reading ? static_cast<uint32_t>(EPOLLIN) : 0;
+        uint32_t out = pending ? static_cast<uint32_t>(EPOLLOUT) : 0;
+        uint32_t interest = EPOLLRDHUP | in | out;
+        if (interest != conn.interest) {
+            epoll_event ev {};
+            ev.events = interest;
+            ev.data.fd = fd;
+            epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &ev);
+            conn.interest = interest;
+        }
+        return true;
+    }
+
+    void drop(int fd) {
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        mConnections.erase(fd);
+        LoopStats::add(mStats.currConnections, -1);
+    }
+
+    int mListenFd;
+    int mEpollFd;
+    Handler mHandler;
+    LoopStats& mStats;
+    std::unordered_map<int, Connection> mConnections;
+};
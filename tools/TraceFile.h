@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum class TraceFormat {
+    Plain,  // one key per line, decimal integers are used as is, anything else is hashed
+    Arc,    // ARC traces: "<start block> <block count> <ignored> <request no>" per line, expands to block count keys
+    Lirs,   // LIRS traces: one block number per line, '*' lines are ignored
+    Binary  // raw native-endian uint64 keys
+};
+
+inline TraceFormat parseTraceFormat(std::string_view name) {
+    if (name == "plain") return TraceFormat::Plain;
+    if (name == "arc") return TraceFormat::Arc;
+    if (name == "lirs") return TraceFormat::Lirs;
+    if (name == "bin" || name == "binary") return TraceFormat::Binary;
+    throw std::invalid_argument("Unknown trace format: " + std::string(name));
+}
+
+// read-only mmap of a whole trace file, keys are parsed straight out of the mapping on every replay
+// so multi-GB traces are never copied into the heap
+class TraceFile {
+public:
+    TraceFile(const std::string& path, TraceFormat format) : mFormat(format) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open trace " + path + ": " + std::strerror(errno));
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat trace " + path + ": " + std::strerror(errno));
+        }
+
+        mSize = st.st_size;
+        if (mSize > 0) {
+            void* addr = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot mmap trace " + path + ": " + std::strerror(errno));
+            }
+            ::madvise(addr, mSize, MADV_SEQUENTIAL);
+            mData = static_cast<const char*>(addr);
+        }
+        ::close(fd);
+    }
+
+    ~TraceFile() {
+        if (mData) {
+            ::munmap(const_cast<char*>(mData), mSize);
+        }
+    }
+
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    size_t bytes() const {
+        return mSize;
+    }
+
+    // calls fn(uint64_t key) for every request in the trace, in order
+    template<typename Fn>
+    void forEachKey(Fn&& fn) const {
+        if (mFormat == TraceFormat::Binary) {
+            size_t count = mSize / sizeof(uint64_t);
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t key;
+                std::memcpy(&key, mData + i * sizeof(uint64_t), sizeof(key));
+                fn(key);
+            }
+            return;
+        }
+
+        const char* cur = mData;
+        const char* end = mData + mSize;
+        while (cur < end) {
+            const char* eol = static_cast<const char*>(std::memchr(cur, '\n', end - cur));
+            if (!eol) {
+                eol = end;
+            }
+            parseLine(std::string_view(cur, eol - cur), fn);
+            cur = eol + 1;
+        }
+    }
+
+private:
+    template<typename Fn>
+    void parseLine(std::string_view line, Fn& fn) const {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            return;
+        }
+
+        switch (mFormat) {
+            case TraceFormat::Plain: {
+                uint64_t key;
+                if (parseUint(line, key) == line.size()) {
+                    fn(key);
+                } else {
+                    fn(static_cast<uint64_t>(std::hash<std::string_view>()(line)));
+                }
+                break;
+            }
+            case TraceFormat::Lirs: {
+                uint64_t key;
+                if (parseUint(line, key) > 0) {
+                    fn(key);
+                }
+                break;
+            }
+            case TraceFormat::Arc: {
+                uint64_t start;
+                uint64_t count;
+                size_t used = parseUint(line, start);
+                if (used == 0) {
+                    return;
+                }
+                line.remove_prefix(used);
+                while (!line.empty() && (line.front() == ' ' || line.front() == '\t')) {
+                    line.remove_prefix(1);
+                }
+                if (parseUint(line, count) == 0) {
+                    count = 1;
+                }
+                for (uint64_t block = start; block < start + count; ++block) {
+                    fn(block);
+                }
+                break;
+            }
+            case TraceFormat::Binary:
+                break;
+        }
+    }
+
+    // parses leading decimal digits into value, returns how many characters were consumed
+    static size_t parseUint(std::string_view text, uint64_t& value) {
+        value = 0;
+        size_t i = 0;
+        while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+            value = value * 10 + (text[i] - '0');
+            ++i;
+        }
+        return i;
+    }
+
+    TraceFormat mFormat;
+    const char* mData = nullptr;
+    size_t mSize = 0;
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// synthetic key streams for hit ratio and throughput runs. every generator fills a buffer up front
+// so that producing keys never shows up in the measurement.
+
+// splitmix64, small and fast enough to generate hundreds of millions of keys per second
+class SplitMix64 {
+public:
+    explicit SplitMix64(uint64_t seed) : mState(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (mState += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [0, bound)
+    uint64_t below(uint64_t bound) {
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(next()) * bound) >> 64);
+    }
+
+    // uniform in [0, 1)
+    double unit() {
+        return (next() >> 11) * 0x1.0p-53;
+    }
+
+private:
+    uint64_t mState;
+};
+
+// zipf over ranks [1, n] with exponent skew, rejection-inversion sampling (Hoermann & Derflinger)
+// so setup and every sample are O(1) whatever the key space
+class ZipfSampler {
+public:
+    ZipfSampler(uint64_t n, double skew) : mN(n), mSkew(skew) {
+        if (n == 0 || skew <= 0) {
+            throw std::invalid_argument("Zipf needs a non-empty key space and a positive skew.");
+        }
+        mHIntegralX1 = hIntegral(1.5) - 1.0;
+        mHIntegralN = hIntegral(n + 0.5);
+        mS = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+    }
+
+    uint64_t sample(SplitMix64& rng) const {
+        while (true) {
+            double u = mHIntegralN + rng.unit() * (mHIntegralX1 - mHIntegralN);
+            double x = hIntegralInverse(u);
+            double k = std::floor(x + 0.5);
+            if (k < 1) {
+                k = 1;
+            } else if (k > mN) {
+                k = mN;
+            }
+            if (k - x <= mS || u >= hIntegral(k + 0.5) - h(k)) {
+                return static_cast<uint64_t>(k);
+            }
+        }
+    }
+
+private:
+    double h(double x) const {
+        return std::exp(-mSkew * std::log(x));
+    }
+
+    double hIntegral(double x) const {
+        double logX = std::log(x);
+        return helper2((1.0 - mSkew) * logX) * logX;
+    }
+
+    double hIntegralInverse(double x) const {
+        double t = x * (1.0 - mSkew);
+        if (t < -1.0) {
+            t = -1.0;
+        }
+        return std::exp(helper1(t) * x);
+    }
+
+    static double helper1(double x) {
+        return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+    }
+
+    static double helper2(double x) {
+        return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+    }
+
+    uint64_t mN;
+    double mSkew;
+    double mHIntegralX1;
+    double mHIntegralN;
+    double mS;
+};
+
+namespace workloads {
+
+// keys drawn from [0, keySpace) with zipf(skew) popularity, key 0 is the hottest
+inline std::vector<uint64_t> zipf(size_t count, uint64_t keySpace, double skew, uint64_t seed = 1) {
+    ZipfSampler sampler(keySpace, skew);
+    SplitMix64 rng(seed);
+    std::vector<uint64_t> keys(count);
+    for (auto& key : keys) {
+        key = sampler.sample(rng) - 1;
+    }
+    return keys;
+}
+
+inline std::vector<uint64_t> uniform(size_t count, uint64_t keySpace, uint64_t seed = 1) {
+    SplitMix64 rng(seed);
+    std::vector<uint64_t> keys(count);
+    for (auto& key : keys) {
+        key = rng.below(keySpace);
+    }
+    return keys;
+}
+
+// first, first + 1, ... every key is requested exactly once
+inline std::vector<uint64_t> scan(size_t count, uint64_t first = 0) {
+    std::vector<uint64_t> keys(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = first + i;
+    }
+    return keys;
+}
+
+// 0, 1, ..., loopLength - 1, 0, 1, ... the classic pattern where recency based policies get no hits
+inline std::vector<uint64_t> loop(size_t count, uint64_t loopLength) {
+    std::vector<uint64_t> keys(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = i % loopLength;
+    }
+    return keys;
+}
+
+// hotFraction of requests go to a hot set of hotSetSize keys, the rest are uniform over keySpace.
+// every phaseLength requests the hot set moves to fresh keys, the case where stale frequencies
+// keep old hot keys cached under pure LFU
+inline std::vector<uint64_t> shiftingHotSet(size_t count, uint64_t keySpace, uint64_t hotSetSize,
+                                            double hotFraction, size_t phaseLength, uint64_t seed = 1) {
+    SplitMix64 rng(seed);
+    std::vector<uint64_t> keys(count);
+    uint64_t hotBase = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0 && i % phaseLength == 0) {
+            hotBase = rng.below(keySpace);
+        }
+        if (rng.unit() < hotFraction) {
+            keys[i] = (hotBase + rng.below(hotSetSize)) % keySpace;
+        } else {
+            keys[i] = rng.below(keySpace);
+        }
+    }
+    return keys;
+}
+
+// base with a one-off scan of scanLength never seen keys spliced in at position at
+inline std::vector<uint64_t> withScan(std::vector<uint64_t> base, size_t at, size_t scanLength) {
+    uint64_t first = 1ULL << 62; // well above any key the other generators produce
+    auto burst = scan(scanLength, first);
+    base.insert(base.begin() + std::min(at, base.size()), burst.begin(), burst.end());
+    return base;
+}
+
+struct Workload {
+    std::string name;
+    std::vector<uint64_t> keys;
+};
+
+// the standard set used by the workload report and benchmarks, count requests each over keySpace keys
+inline std::vector<Workload> standardSet(size_t count, uint64_t keySpace, double skew = 0.99) {
+    // loop length, hot set and phase are fractions of the run, kept at 1 or more for tiny runs
+    uint64_t loopLength = std::max<uint64_t>(keySpace / 10, 1);
+    uint64_t hotSetSize = std::max<uint64_t>(keySpace / 100, 1);
+    size_t phaseLength = std::max<size_t>(count / 10, 1);
+    std::vector<Workload> set;
+    set.push_back({"zipf", zipf(count, keySpace, skew)});
+    set.push_back({"uniform", uniform(count, keySpace)});
+    set.push_back({"scan", scan(count)});
+    set.push_back({"loop", loop(count, loopLength)});
+    set.push_back({"shifting-hot-set", shiftingHotSet(count, keySpace, hotSetSize, 0.9, phaseLength)});
+    set.push_back({"zipf+scan", withScan(zipf(count, keySpace, skew, 2), count / 2, count / 4)});
+    return set;
+}
+
+} // namespace workloads
@@ -0,0 +1,81 @@
+// replays keys read from stdin (one per line) through an LFUCache and prints how the cached keys
+// are spread across frequencies, the hottest keys and the age of the next eviction victim
+//
+//   usage: freq_histogram <capacity> [top-k] < keys.txt
+
+#include <bit>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "../LFUCache.h"
+
+int main(int argc, char** argv) {
+    auto usage = [&] {
+        std::cerr << "usage: " << argv[0] << " <capacity> [top-k] < keys.txt\n";
+        return 1;
+    };
+    if (argc < 2) {
+        return usage();
+    }
+
+    size_t capacity = 0;
+    size_t topK = 10;
+    try {
+        capacity = std::stoull(argv[1]);
+        if (argc > 2) {
+            topK = std::stoull(argv[2]);
+        }
+    } catch (const std::logic_error&) {
+        // not a number or out of range
+        return usage();
+    }
+    if (capacity == 0) {
+        return usage();
+    }
+
+    LFUCache<std::string, int> cache(capacity);
+    std::string key;
+    uint64_t requests = 0;
+    uint64_t hits = 0;
+    while (std::getline(std::cin, key)) {
+        requests += 1;
+        // one lookup: a hit only counts the use, a miss inserts
+        if (!cache.emplace(key, 0).second) {
+            hits += 1;
+        }
+    }
+
+    std::cout << "requests " << requests << ", hits " << hits << ", cached keys " << cache.size() << "\n\n";
+
+    // frequencies are grouped into power of two ranges so heavy tails stay readable
+    std::vector<std::pair<int, size_t>> ranges; // lowest freq of range -> keys in range
+    size_t maxCount = 0;
+    for (const auto& bucket : cache.freqDistribution()) {
+        int low = std::bit_floor(static_cast<unsigned>(bucket.freq));
+        if (ranges.empty() || ranges.back().first != low) {
+            ranges.emplace_back(low, 0);
+        }
+        ranges.back().second += bucket.count;
+        maxCount = std::max(maxCount, ranges.back().second);
+    }
+
+    constexpr size_t barWidth = 50;
+    std::cout << std::setw(16) << "freq" << std::setw(12) << "keys" << "\n";
+    for (const auto& [low, count] : ranges) {
+        std::string range = std::to_string(low) + "-" + std::to_string(low * 2 - 1);
+        std::cout << std::setw(16) << range << std::setw(12) << count << " "
+                  << std::string((count * barWidth + maxCount - 1) / maxCount, '#') << "\n";
+    }
+
+    std::cout << "\ntop " << topK << " keys\n";
+    for (const auto& [hotKey, freq] : cache.hottestKeys(topK)) {
+        std::cout << std::setw(12) << freq << "  " << hotKey << "\n";
+    }
+
+#ifdef LFU_CACHE_ENTRY_AGE
+    std::cout << "\nnext victim last used " << cache.oldestMinFreqAge() << " inserts/touches ago\n";
+#endif
+    return 0;
+}
@@ -0,0 +1,137 @@
+// serves a sharded LFUCache over the memcached text protocol or RESP, one epoll loop per core
+//
+//   usage: lfu_server [-P memcached|resp] [-l host] [-p port | -s unix socket path] [-t threads] [-c capacity]
+//                     [-n shards]
+
+#include <atomic>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "MemcachedProtocol.h"
+#include "RespProtocol.h"
+#include "Server.h"
+
+static std::atomic<bool> gStop {false};
+
+static void onSignal(int) {
+    gStop.store(true);
+}
+
+static void usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [-P memcached|resp] [-l host] [-p port | -s unix socket path]"
+              << " [-t threads] [-c capacity] [-n shards]\n";
+}
+
+// keeps loop i on core i, so a loop's connections and its slice of the stats stay on one cache
+static void pinToCore(std::thread& thread, size_t core) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % std::max(1u, std::thread::hardware_concurrency()), &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+}
+
+template<typename Handler>
+static void serve(ServerState& state, int listenFd, size_t index) {
+    EventLoop<Handler> loop(listenFd, Handler(state, state.stats[index]), state.stats[index]);
+    loop.run(gStop);
+}
+
+int main(int argc, char** argv) {
+    std::string protocol = "memcached";
+    std::string host;
+    uint16_t port = 0;
+    std::string unixPath;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t capacity = 1000000;
+    size_t shards = 0;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "-P" && i + 1 < argc) {
+                protocol = argv[++i];
+            } else if (arg == "-l" && i + 1 < argc) {
+                host = argv[++i];
+            } else if (arg == "-p" && i + 1 < argc) {
+                unsigned long value = std::stoul(argv[++i]);
+                if (value > 65535) {
+                    throw std::out_of_range("port");
+                }
+                port = static_cast<uint16_t>(value);
+            } else if (arg == "-s" && i + 1 < argc) {
+                unixPath = argv[++i];
+            } else if (arg == "-t" && i + 1 < argc) {
+                threads = std::stoull(argv[++i]);
+            } else if (arg == "-c" && i + 1 < argc) {
+                capacity = std::stoull(argv[++i]);
+            } else if (arg == "-n" && i + 1 < argc) {
+                shards = std::stoull(argv[++i]);
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    } catch (const std::logic_error&) {
+        // a port, thread count, capacity or shard count that is not a number or out of range
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads == 0 || capacity == 0 || (protocol != "memcached" && protocol != "resp")) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (port == 0) {
+        port = protocol == "resp" ? 6379 : 11211;
+    }
+    if (shards == 0) {
+        shards = threads * 4; // a few shards per loop keeps two loops from often wanting the same lock
+    }
+
+    int listenFd = -1;
+    try {
+        listenFd = unixPath.empty() ? listenTcp(host, port) : listenUnix(unixPath);
+    } catch (const std::runtime_error& err) {
+        // an address that does not resolve, a port in use or a socket path that cannot be bound
+        std::cerr << err.what() << "\n";
+        usage(argv[0]);
+        return 1;
+    }
+    ServerState state(capacity, shards, threads);
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    std::signal(SIGPIPE, SIG_IGN); // replies go out with writev, which has no MSG_NOSIGNAL
+
+    std::vector<std::thread> loops;
+    for (size_t i = 0; i < threads; ++i) {
+        loops.emplace_back([&state, &protocol, listenFd, i] {
+            if (protocol == "resp") {
+                serve<RespHandler>(state, listenFd, i);
+            } else {
+                serve<MemcachedHandler>(state, listenFd, i);
+            }
+        });
+        pinToCore(loops.back(), i);
+    }
+    std::cerr << "lfu_server: " << protocol << ", " << threads << " loops, " << state.cache.shardCount()
+              << " shards, capacity " << capacity << ", listening on " << (unixPath.empty() ? host + ":" + std::to_string(port) : unixPath)
+              << "\n";
+
+    for (auto& loop : loops) {
+        loop.join();
+    }
+    close(listenFd);
+    if (!unixPath.empty()) {
+        unlink(unixPath.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+// replays a key trace through LFUCache at several capacities and reports hit ratio and throughput
+//
+//   usage: trace_sim [-f plain|arc|lirs|bin] [-c 1000,10000,100000] <trace file>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../LFUCache.h"
+#include "TraceFile.h"
+
+static std::vector<size_t> parseCapacities(const std::string& list) {
+    std::vector<size_t> capacities;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        capacities.push_back(std::stoull(item));
+    }
+    return capacities;
+}
+
+static void usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [-f plain|arc|lirs|bin] [-c 1000,10000,100000] <trace file>\n";
+}
+
+int main(int argc, char** argv) {
+    TraceFormat format = TraceFormat::Plain;
+    std::vector<size_t> capacities {1000, 10000, 100000};
+    std::string path;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "-f" && i + 1 < argc) {
+                format = parseTraceFormat(argv[++i]);
+            } else if (arg == "-c" && i + 1 < argc) {
+                capacities = parseCapacities(argv[++i]);
+            } else if (path.empty() && arg[0] != '-') {
+                path = arg;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+    } catch (const std::logic_error&) {
+        // an unknown format, or a capacity that is not a number or out of range
+        usage(argv[0]);
+        return 1;
+    }
+    if (path.empty() || capacities.empty() || std::find(capacities.begin(), capacities.end(), 0) != capacities.end()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::optional<TraceFile> trace;
+    try {
+        trace.emplace(path, format);
+    } catch (const std::runtime_error& err) {
+        // a trace that cannot be opened or mapped
+        std::cerr << err.what() << "\n";
+        usage(argv[0]);
+        return 1;
+    }
+    std::cout << std::setw(12) << "capacity" << std::setw(14) << "requests" << std::setw(14) << "hits"
+              << std::setw(12) << "hit ratio" << std::setw(14) << "Mops/s" << "\n";
+
+    for (size_t capacity : capacities) {
+        LFUCache<uint64_t, uint64_t> cache(capacity);
+        uint64_t requests = 0;
+        uint64_t hits = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        trace->forEachKey([&](uint64_t key) {
+            requests += 1;
+            // one lookup: a hit only counts the use, a miss inserts
+            if (!cache.emplace(key, key).second) {
+                hits += 1;
+            }
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << std::setw(12) << capacity << std::setw(14) << requests << std::setw(14) << hits
+                  << std::setw(12) << std::fixed << std::setprecision(4)
+                  << (requests ? static_cast<double>(hits) / requests : 0.0)
+                  << std::setw(14) << std::setprecision(2) << (seconds > 0 ? requests / seconds / 1e6 : 0.0)
+                  << "\n";
+    }
+    return 0;
+}
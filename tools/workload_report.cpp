@@ -0,0 +1,119 @@
+// hit ratio and throughput of LFUCache over the synthetic workloads in Workloads.h
+//
+//   usage: workload_report [-n requests] [-k key space] [-s zipf skew] [-c 100,1000,10000] [-r repeats]
+//                          [-w zipf,scan,...]
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "../LFUCache.h"
+#include "Workloads.h"
+
+struct RunResult {
+    uint64_t hits;
+    double seconds;
+};
+
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+static RunResult replay(const std::vector<uint64_t>& keys, size_t capacity) {
+    LFUCache<uint64_t, uint64_t> cache(capacity);
+    uint64_t hits = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t key : keys) {
+        // one lookup: a hit only counts the use, a miss inserts
+        if (!cache.emplace(key, key).second) {
+            hits += 1;
+        }
+    }
+    return {hits, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()};
+}
+
+int main(int argc, char** argv) {
+    size_t requests = 2'000'000;
+    uint64_t keySpace = 100'000;
+    double skew = 0.99;
+    std::vector<size_t> capacities {100, 1000, 10000};
+    int repeats = 3;
+    std::vector<std::string> only; // workload names to run, all when empty
+
+    auto usage = [&] {
+        std::cerr << "usage: " << argv[0]
+                  << " [-n requests] [-k key space] [-s zipf skew] [-c 100,1000,10000] [-r repeats]"
+                  << " [-w zipf,scan,...]\n";
+        return 1;
+    };
+    try {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            std::string arg = argv[i];
+            if (arg == "-n") {
+                requests = std::stoull(argv[i + 1]);
+            } else if (arg == "-k") {
+                keySpace = std::stoull(argv[i + 1]);
+            } else if (arg == "-s") {
+                skew = std::stod(argv[i + 1]);
+            } else if (arg == "-r") {
+                repeats = std::max(1, std::stoi(argv[i + 1]));
+            } else if (arg == "-c") {
+                capacities.clear();
+                for (const auto& item : splitList(argv[i + 1])) {
+                    capacities.push_back(std::stoull(item));
+                }
+            } else if (arg == "-w") {
+                only = splitList(argv[i + 1]);
+            } else {
+                return usage();
+            }
+        }
+    } catch (const std::logic_error&) {
+        // std::stoull and friends on something that is not a number or out of range
+        return usage();
+    }
+    if (keySpace == 0 || skew <= 0 || std::find(capacities.begin(), capacities.end(), 0) != capacities.end()) {
+        return usage();
+    }
+
+    auto genStart = std::chrono::steady_clock::now();
+    auto set = workloads::standardSet(requests, keySpace, skew);
+    if (!only.empty()) {
+        std::erase_if(set, [&](const workloads::Workload& workload) {
+            return std::find(only.begin(), only.end(), workload.name) == only.end();
+        });
+    }
+    double genSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - genStart).count();
+    std::cout << "generated " << set.size() << " workloads of ~" << requests << " requests over " << keySpace
+              << " keys in " << std::fixed << std::setprecision(2) << genSeconds << "s\n\n";
+
+    std::cout << std::left << std::setw(18) << "workload" << std::right << std::setw(10) << "capacity"
+              << std::setw(12) << "hit ratio" << std::setw(12) << "Mops/s" << "\n";
+    for (const auto& workload : set) {
+        for (size_t capacity : capacities) {
+            // hit ratio is deterministic, throughput is the best of the repeats
+            RunResult best = replay(workload.keys, capacity);
+            for (int r = 1; r < repeats; ++r) {
+                RunResult run = replay(workload.keys, capacity);
+                best.seconds = std::min(best.seconds, run.seconds);
+            }
+
+            std::cout << std::left << std::setw(18) << workload.name << std::right << std::setw(10) << capacity
+                      << std::setw(12) << std::setprecision(4)
+                      << static_cast<double>(best.hits) / workload.keys.size()
+                      << std::setw(12) << std::setprecision(2) << workload.keys.size() / best.seconds / 1e6 << "\n";
+        }
+    }
+    return 0;
+}